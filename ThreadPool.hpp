@@ -27,15 +27,43 @@
 #ifndef SIMULATOR_THREADPOOL_H
 #define SIMULATOR_THREADPOOL_H
 
+#include <algorithm>
+#include <array>
 #include <atomic>
+#include <bit>
+#include <chrono>
 #include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
 #include <exception>
+#include <fstream>
 #include <functional>
+#include <future>
+#include <iterator>
+#include <memory>
 #include <mutex>
-#include <queue>
+#include <new>
+#include <optional>
+#include <ostream>
+#include <ranges>
 #include <semaphore>
 #include <span>
+#include <stdexcept>
+#include <stop_token>
+#include <string>
 #include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
 
 /*
  * University of Michigan Solar Car Team
@@ -55,173 +83,5008 @@
  *      detach_task - used to add a single task to the thread pool
  *      detach_tasks - used to add multiple tasks to the thread pool
  *
+ * submit also adds a single task, returning a TaskFuture for its result (or exception). wait_all waits on a
+ * whole range of futures at the cost of at most one kernel wait.
+ *
+ * Tasks are stored in a move-only InplaceTask, so detach_task accepts move-only callables, and callables up to
+ * THREADPOOL_TASK_BUFFER_SIZE bytes are stored without a heap allocation. Larger callables, submit states and
+ * coroutine frames are recycled through TaskNodeCache (unless THREADPOOL_RECYCLE_TASK_NODES is 0), and the
+ * blocking calls queue by-reference helper jobs that never allocate.
+ *
  * Within the blocking API, there are two functions:
  *      run_tasks - used to add multiple tasks to the thread pool and wait for them to finish
  *      run_loop - used to add a loop of tasks to the thread pool and wait for them to finish (syntax sugar)
+ *      run_graph - used to run a TaskGraph of dependent tasks and wait for all of them to finish
+ *
+ * If a task of a blocking call throws, the call still waits for the rest of its batch and then rethrows the
+ * first exception on the calling thread. With OnError::cancel the tasks that have not started by then are
+ * skipped. An exception escaping a detached task terminates the program, as with std::thread; use submit to
+ * get it back instead.
+ *
+ * TaskOptions::stop_token cancels queued tasks: a task whose token has been stopped is skipped when a worker
+ * picks it up. Tasks that take a std::stop_token are passed one that is stopped when the pool stops (workers are
+ * std::jthreads) or when their own token is.
+ *
+ * A WaitGroup counts outstanding work with one atomic and wakes its waiters once when it reaches zero.
+ * TaskOptions::group adds a detached task to a group, and pool.wait(groups...) waits for several groups while
+ * helping with queued tasks. run_tasks, run_loop and run_graph wait on a WaitGroup internally.
+ *
+ * shutdown(Shutdown::drain) runs every queued task before stopping, shutdown(Shutdown::cancel_pending) drops them
+ * and shutdown_for(timeout) drains for a bounded time; all three return the number of tasks dropped. The
+ * destructor drops queued tasks. wait_idle blocks until no task is queued or running.
+ *
+ * Coroutines: co_await pool.schedule() resumes a coroutine on a worker. AsyncTask<T> is a lazily started
+ * coroutine that can be co_awaited, when_all awaits several at once, and sync_wait blocks a thread outside the
+ * pool until one has finished.
+ *
+ * The calling thread of a blocking call works through the batch alongside the workers and, on a worker of the
+ * same pool, runs other queued jobs while it waits for the rest. Blocking calls can therefore be nested inside
+ * tasks without deadlocking the pool.
+ *
+ * run_loop splits its index range into chunks according to a Schedule, so a loop costs one task per worker
+ * rather than one task per index. Its body either takes one index or a [begin, end) sub-range. Schedule::adaptive
+ * sizes the chunks from the measured cost per index, remembered per loop body type, and only splits a worker's
+ * block when another one runs out of work.
+ *
+ * parallel_reduce, parallel_transform, parallel_inclusive_scan, parallel_exclusive_scan and parallel_sort work
+ * on random access ranges on top of the same chunked scheduling. Reductions keep one cache-line-aligned partial
+ * per participant.
+ *
+ * A BasicThreadPool::Strand runs its tasks one at a time in FIFO order, as a job on the pool that never waits,
+ * and TaskOptions::worker pins a task to one worker's inbox, which is never stolen from.
+ *
+ * worker_index() tells a task which worker runs it, and BasicThreadPool::Local<T> keeps one lazily constructed T
+ * per worker (and per outside thread) with each and combine for reductions after a batch.
+ *
+ * A TaskGraph is built once and re-run without allocating. A node runs as soon as its last predecessor
+ * finishes, on the worker that finished it, instead of waiting for a barrier between stages.
+ *
+ *
+ * Scheduling:
+ *
+ * By default every task goes through one shared FIFO queue. Constructing the pool with
+ * SchedulingMode::work_stealing gives each worker its own deque instead: tasks submitted from a worker are
+ * pushed to (and popped LIFO from) that worker's deque, idle workers steal the oldest tasks from the other
+ * deques. A batch submitted from outside the pool (detach_tasks, or the helper jobs of a blocking call) is split
+ * straight across the workers' deques, one slice and one lock per worker; a single task from outside, and tasks
+ * in the high or background lane, go through the global queue.
+ *
+ * The global queue is a compile time policy of BasicThreadPool: UnboundedQueue (a growable ring behind a mutex,
+ * what ThreadPool uses), BoundedQueue<Capacity> (a lock-free MPMC ring) or SingleProducerQueue<Capacity> (a
+ * lock-free ring whose push needs no CAS, for a single submitting thread outside the pool; the pool's own threads
+ * queue beside it). Bounded queues apply backpressure: submitting to a full queue waits for room, and
+ * try_detach_task returns false instead.
+ *
+ * An Affinity pins workers to CPUs or groups them by NUMA node (topology read from /sys on Linux). Workers then
+ * prefer their own node's queue and same-node victims, and TaskOptions::numa_node sends a task to the queue
+ * of the node holding its data.
+ *
+ * TaskOptions::priority puts a task in one of three global lanes. Workers serve the high lane before anything
+ * else and the background lane only when there is nothing else, except that every lane_aging_interval picks
+ * they look at the lower lanes first, so a steady stream of urgent work cannot starve the rest.
+ *
+ * Idle workers spin, then yield, then park, as set by an IdlePolicy. Submitting only makes a system call when
+ * a worker is actually parked.
+ *
+ * schedule_after and schedule_every queue a task once a delay has passed, or every period. The timers live in a
+ * hierarchical TimerWheel (O(1) insert and cancel); one parked worker parks with a timeout at the next deadline
+ * and busy workers poll between tasks, so no timer thread is needed unless TimerPolicy asks for one.
+ *
+ * reset() grows or shrinks the pool at runtime; retiring workers finish their current task and hand their deque
+ * back to the global queue. An ElasticPolicy lets the pool add workers up to a maximum while its queues stay
+ * backed up, and retire them again once they have been idle for the keep-alive.
+ *
+ * BasicThreadPool<QueuePolicy, true> (InstrumentedThreadPool) keeps per-worker counters of tasks run, busy and
+ * idle time, deque lock waits, steals and a queue wait histogram, read with stats(). Without the flag none of the
+ * counters or timestamps is compiled in.
+ *
+ * start_tracing records the begin and end of every task (labelled with TaskOptions::label) and of every blocking
+ * call in a lock-free ring per worker; write_trace dumps them as Chrome trace_event JSON.
  *
  */
 
-template <typename>
-struct extract_argument;
+#ifndef THREADPOOL_TASK_BUFFER_SIZE
+/// Bytes of inline storage in a task, callables that do not fit are heap-allocated
+#define THREADPOOL_TASK_BUFFER_SIZE 64
+#endif
 
-template <typename T>
-struct extract_argument<std::function<void(T)>> {
-	using type = T;
-};
+#ifndef THREADPOOL_RECYCLE_TASK_NODES
+/// Whether heap-allocated task nodes (large callables, submit states, coroutine frames) are recycled through
+/// TaskNodeCache instead of going back to the allocator
+#define THREADPOOL_RECYCLE_TASK_NODES 1
+#endif
 
-template <>
-struct extract_argument<std::function<void()>> {
-	using type = void;
+/// @brief Free lists for the heap blocks of task nodes, which are usually freed on a different thread than the
+/// one that allocated them
+///
+/// Blocks come in size classes of 128, 256 and 512 bytes; larger ones go straight to operator new. Every thread
+/// caches up to 2 * batch_size blocks per class and trades them with a shared free list batch_size at a time, so
+/// a worker freeing what a submitter allocated costs one lock per batch instead of a cross-thread free per node.
+/// The shared list keeps at most max_shared_batches per class and frees the rest.
+class TaskNodeCache {
+   public:
+	/// @brief Allocates at least size bytes, aligned for std::max_align_t
+	static void* allocate(size_t size) {
+		size_t size_class = class_of(size);
+		if (size_class == classes) {
+			return ::operator new(size);
+		}
+		FreeList& local = local_lists().lists[size_class];
+		if (!local.head) {
+			Shared& shared = shared_lists();
+			std::scoped_lock<std::mutex> lock(shared.lock);
+			std::vector<FreeBlock*>& batches = shared.batches[size_class];
+			if (batches.empty()) {
+				return ::operator new(class_size(size_class));
+			}
+			local.head = batches.back();
+			local.count = batch_size;
+			batches.pop_back();
+		}
+		FreeBlock* block = local.head;
+		local.head = block->next;
+		local.count--;
+		return block;
+	}
+
+	/// @brief Returns a block from allocate(size)
+	static void deallocate(void* pointer, size_t size) noexcept {
+		size_t size_class = class_of(size);
+		if (size_class == classes) {
+			::operator delete(pointer);
+			return;
+		}
+		FreeList& local = local_lists().lists[size_class];
+		local.head = ::new (pointer) FreeBlock{local.head};
+		if (++local.count == 2 * batch_size) {
+			give_back(local, size_class);
+		}
+	}
+
+   private:
+	static constexpr size_t classes = 3;
+	static constexpr size_t smallest_class = 128;
+	static constexpr size_t batch_size = 32;
+	static constexpr size_t max_shared_batches = 256;
+
+	struct FreeBlock {
+		FreeBlock* next;
+	};
+
+	struct FreeList {
+		FreeBlock* head = nullptr;
+		size_t count = 0;
+	};
+
+	struct Shared {
+		std::mutex lock;
+		/// Chains of batch_size blocks, per size class
+		std::array<std::vector<FreeBlock*>, classes> batches;
+	};
+
+	/// @brief A thread's free lists, handed back to the shared list when the thread exits
+	struct LocalLists {
+		~LocalLists() {
+			for (size_t size_class = 0; size_class < classes; size_class++) {
+				while (lists[size_class].count >= batch_size) {
+					give_back(lists[size_class], size_class);
+				}
+				for (FreeBlock* block = lists[size_class].head; block;) {
+					::operator delete(std::exchange(block, block->next));
+				}
+			}
+		}
+
+		std::array<FreeList, classes> lists;
+	};
+
+	static size_t class_of(size_t size) noexcept {
+		size_t size_class = 0;
+		while (size_class < classes && size > class_size(size_class)) {
+			size_class++;
+		}
+		return size_class;
+	}
+
+	static constexpr size_t class_size(size_t size_class) noexcept {
+		return smallest_class << size_class;
+	}
+
+	/// @brief Moves batch_size blocks from a thread's list to the shared list (or frees them if it is full)
+	static void give_back(FreeList& local, size_t size_class) noexcept {
+		FreeBlock* batch = local.head;
+		FreeBlock* last = batch;
+		for (size_t i = 1; i < batch_size; i++) {
+			last = last->next;
+		}
+		local.head = std::exchange(last->next, nullptr);
+		local.count -= batch_size;
+		{
+			Shared& shared = shared_lists();
+			std::scoped_lock<std::mutex> lock(shared.lock);
+			std::vector<FreeBlock*>& batches = shared.batches[size_class];
+			if (batches.size() < max_shared_batches) {
+				if (batches.capacity() == 0) {
+					batches.reserve(max_shared_batches);
+				}
+				batches.push_back(batch);
+				return;
+			}
+		}
+		while (batch) {
+			::operator delete(std::exchange(batch, batch->next));
+		}
+	}
+
+	static LocalLists& local_lists() noexcept {
+		static thread_local LocalLists lists;
+		return lists;
+	}
+
+	/// @brief Never destroyed, so that threads exiting during static destruction can still give blocks back
+	static Shared& shared_lists() noexcept {
+		static Shared& shared = *new Shared;
+		return shared;
+	}
 };
 
-template <typename Func>
-using extract_argument_t = typename extract_argument<Func>::type;
+/// @brief Class operator new and delete that recycle through TaskNodeCache, for the nodes of tasks
+struct RecycledNode {
+#if THREADPOOL_RECYCLE_TASK_NODES
+	static void* operator new(size_t size) {
+		return TaskNodeCache::allocate(size);
+	}
 
-class ThreadPool {
+	static void operator delete(void* pointer, size_t size) noexcept {
+		TaskNodeCache::deallocate(pointer, size);
+	}
+#endif
+};
+
+/// @brief Move-only type-erased void() callable with inline storage for small callables
+///
+/// Callables of at most BufferSize bytes, no more aligned than std::max_align_t and nothrow move constructible
+/// are stored in the task itself; anything else is heap-allocated, in a block recycled through TaskNodeCache.
+template <size_t BufferSize>
+class InplaceTask {
    public:
-	ThreadPool() {
-		reset(std::thread::hardware_concurrency());
+	/// @brief Whether a callable of type F is stored without a heap allocation
+	template <typename F>
+	static constexpr bool stored_inline = sizeof(F) <= BufferSize && alignof(F) <= alignof(std::max_align_t) &&
+										  std::is_nothrow_move_constructible_v<F>;
+
+	InplaceTask() noexcept = default;
+
+	template <typename Func, typename F = std::decay_t<Func>>
+		requires(!std::is_same_v<F, InplaceTask> && std::is_invocable_v<F&> && std::is_move_constructible_v<F>)
+	InplaceTask(Func&& func) {
+		if constexpr (stored_inline<F>) {
+			::new (static_cast<void*>(storage)) F(std::forward<Func>(func));
+		} else {
+			::new (static_cast<void*>(storage)) Node<F>*(new Node<F>{{}, F(std::forward<Func>(func))});
+		}
+		vtable = &vtable_for<F>;
 	}
 
-	/// @brief  Construct a thread pool with a specific number of threads
-	/// @param num_threads Number of threads for the pool
-	explicit ThreadPool(size_t num_threads) {
-		reset(num_threads);
+	InplaceTask(InplaceTask&& other) noexcept : vtable(std::exchange(other.vtable, nullptr)) {
+		if (vtable) {
+			vtable->move(storage, other.storage);
+		}
 	}
 
-	~ThreadPool() {
-		running = false;
-		cv.notify_all();
-		for (auto& thread : threads) {
-			thread.join();
+	InplaceTask& operator=(InplaceTask&& other) noexcept {
+		if (this != &other) {
+			reset();
+			vtable = std::exchange(other.vtable, nullptr);
+			if (vtable) {
+				vtable->move(storage, other.storage);
+			}
 		}
+		return *this;
 	}
 
-	/// @brief  Reset the number of threads in the pool
-	/// @param num_threads Number of threads for the pool
-	/// @throws std::runtime_error if the number of threads is less than the current number of threads
-	void reset(size_t num_threads) {
-		if (num_threads >= threads.size()) {
-			size_t i = threads.size();
-			for (; i < num_threads; i++) {
-				threads.emplace_back([this] { worker_loop(); });
+	InplaceTask(const InplaceTask&) = delete;
+	InplaceTask& operator=(const InplaceTask&) = delete;
+
+	~InplaceTask() {
+		reset();
+	}
+
+	/// @brief Invoke the stored callable (the task must not be empty)
+	void operator()() {
+		vtable->invoke(storage);
+	}
+
+	/// @brief Whether the task holds a callable
+	explicit operator bool() const noexcept {
+		return vtable != nullptr;
+	}
+
+	/// @brief Destroy the stored callable, leaving the task empty
+	void reset() noexcept {
+		if (vtable) {
+			std::exchange(vtable, nullptr)->destroy(storage);
+		}
+	}
+
+   private:
+	struct VTable {
+		void (*invoke)(void* storage);
+		/// Move constructs into destination and destroys source
+		void (*move)(void* destination, void* source) noexcept;
+		void (*destroy)(void* storage) noexcept;
+	};
+
+	/// @brief Heap storage of a callable that is not stored inline
+	template <typename F>
+	struct Node : std::conditional_t<alignof(F) <= alignof(std::max_align_t), RecycledNode, std::monostate> {
+		F func;
+	};
+
+	template <typename F>
+	static F& target(void* storage) noexcept {
+		if constexpr (stored_inline<F>) {
+			return *std::launder(static_cast<F*>(storage));
+		} else {
+			return (*std::launder(static_cast<Node<F>**>(storage)))->func;
+		}
+	}
+
+	template <typename F>
+	static constexpr VTable vtable_for = {
+		[](void* storage) { target<F>(storage)(); },
+		[](void* destination, void* source) noexcept {
+			if constexpr (stored_inline<F>) {
+				F& func = target<F>(source);
+				::new (destination) F(std::move(func));
+				func.~F();
+			} else {
+				::new (destination) Node<F>*(*std::launder(static_cast<Node<F>**>(source)));
+			}
+		},
+		[](void* storage) noexcept {
+			if constexpr (stored_inline<F>) {
+				target<F>(storage).~F();
+			} else {
+				delete *std::launder(static_cast<Node<F>**>(storage));
+			}
+		},
+	};
+
+	alignas(std::max_align_t) std::byte storage[BufferSize];
+	const VTable* vtable = nullptr;
+};
+
+/// @brief Reference counted completion state shared by a TaskFuture and its task
+///
+/// At most one thread waits on a state at a time: it registers a countdown that the task decrements when it
+/// completes, so waiting on many states costs one kernel wait in total.
+class FutureStateBase : public RecycledNode {
+   public:
+	virtual ~FutureStateBase() = default;
+
+	bool ready() const noexcept {
+		return status.load(std::memory_order_acquire) == ready_status;
+	}
+
+	/// @brief Make the task count pending down by one when it completes
+	/// @return false if the task has already completed, in which case pending is not touched
+	bool add_waiter(std::atomic<uint32_t>& pending) noexcept {
+		uintptr_t expected = 0;
+		return status.compare_exchange_strong(expected, reinterpret_cast<uintptr_t>(&pending),
+											  std::memory_order_acq_rel, std::memory_order_acquire);
+	}
+
+	/// @brief Block until every state in the range is ready
+	template <typename States>
+	static void wait_all(const States& states) {
+		std::atomic<uint32_t> pending = 1;  // held by this thread until every state is registered
+		for (FutureStateBase* state : states) {
+			pending.fetch_add(1, std::memory_order_relaxed);
+			if (!state->add_waiter(pending)) {
+				pending.fetch_sub(1, std::memory_order_relaxed);
 			}
+		}
+		if (pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
 			return;
 		}
-		throw std::runtime_error("Cannot downscale thread pool");
+		for (uint32_t count; (count = pending.load(std::memory_order_acquire)) != 0;) {
+			pending.wait(count, std::memory_order_acquire);
+		}
 	}
 
-	/// @brief  Get the number of threads in the pool
-	size_t size() const {
-		return threads.size();
+	void release() noexcept {
+		if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+			delete this;
+		}
 	}
 
-	// ********** Non-blocking API **********
-
-	/// @brief Add a task to the thread pool
-	/// @param task The task to be added
-	void detach_task(std::function<void()>&& task) {
-		{
-			std::scoped_lock<std::mutex> lock(data_lock);
-			jobs.emplace(std::move(task));
+   protected:
+	void mark_ready() noexcept {
+		uintptr_t previous = status.exchange(ready_status, std::memory_order_acq_rel);
+		if (previous != 0) {
+			auto* pending = reinterpret_cast<std::atomic<uint32_t>*>(previous);
+			if (pending->fetch_sub(1, std::memory_order_acq_rel) == 1) {
+				pending->notify_all();
+			}
 		}
-		cv.notify_one();
 	}
 
-	/// @brief Adds tasks to the thread pool
-	/// @param tasks A container of tasks to be added (not valid after this function returns)
-	void detach_tasks(std::span<std::function<void()>> tasks) {
-		{
-			std::scoped_lock<std::mutex> lock(data_lock);
-			for (auto& task : tasks) {
-				jobs.emplace(std::move(task));
+   private:
+	static constexpr uintptr_t ready_status = 1;
+
+	/// 0 while pending, ready_status once complete, otherwise the address of the waiter's countdown
+	std::atomic<uintptr_t> status = 0;
+	/// One reference for the future and one for the task
+	std::atomic<uint32_t> refs = 2;
+};
+
+/// @brief Result (or exception) of a submitted task
+template <typename R>
+class FutureState : public FutureStateBase {
+   public:
+	/// @brief Store the task's result, or the exception that it threw, and release waiters
+	template <typename Call>
+	void complete(Call& call) noexcept {
+		try {
+			if constexpr (std::is_void_v<R>) {
+				call();
+			} else {
+				value.emplace(call());
 			}
+		} catch (...) {
+			error = std::current_exception();
 		}
-		cv.notify_all();
 	}
 
-	// ********** Blocking API **********
+	/// @brief Fail the future because its task was destroyed without running
+	void abandon() noexcept {
+		error = std::make_exception_ptr(std::future_error(std::future_errc::broken_promise));
+	}
 
-	/// @brief Adds tasks to the thread pool and waits for them to finish
-	/// @param tasks A container of tasks to be added (not valid after this function returns)
-	void run_tasks(std::span<std::function<void()>> tasks) {
-		std::counting_semaphore sem(0);
-		{
-			std::scoped_lock<std::mutex> lock(data_lock);
-			for (auto& task : tasks) {
-				jobs.emplace([&]() {
-					task();
-					sem.release();
-				});
+	R get() {
+		if (error) {
+			std::rethrow_exception(error);
+		}
+		if constexpr (!std::is_void_v<R>) {
+			if constexpr (std::is_reference_v<R>) {
+				return value->get();
+			} else {
+				return std::move(*value);
 			}
 		}
-		cv.notify_all();
-		for (size_t i = 0; i < tasks.size(); i++) {
-			sem.acquire();
+	}
+
+   private:
+	using stored_type = std::conditional_t<
+		std::is_void_v<R>, std::nullptr_t,
+		std::conditional_t<std::is_reference_v<R>, std::reference_wrapper<std::remove_reference_t<R>>, R>>;
+
+	std::optional<stored_type> value;
+	std::exception_ptr error;
+};
+
+/// @brief A future state allocated together with the callable that produces its result
+template <typename R, typename Call>
+class CallState final : public FutureState<R> {
+   public:
+	explicit CallState(Call&& call) : call(std::move(call)) {}
+
+	void run() noexcept {
+		this->complete(*call);
+		call.reset();
+		this->mark_ready();
+	}
+
+	void abandon() noexcept {
+		call.reset();
+		FutureState<R>::abandon();
+		this->mark_ready();
+	}
+
+   private:
+	std::optional<Call> call;
+};
+
+/// @brief The task side of a CallState, small enough to be stored inline in a task
+///
+/// Destroying it without running (e.g. when the pool is destroyed with the task still queued) fails the
+/// future with std::future_errc::broken_promise.
+template <typename State>
+class FutureTask {
+   public:
+	explicit FutureTask(State* state) noexcept : state(state) {}
+	FutureTask(FutureTask&& other) noexcept : state(std::exchange(other.state, nullptr)) {}
+	FutureTask& operator=(FutureTask&&) = delete;
+
+	~FutureTask() {
+		if (state) {
+			state->abandon();
+			state->release();
 		}
 	}
 
-	/// @brief Adds tasks to the thread pool and waits for them to finish
-	/// @param start The start index of the loop
-	/// @param end The end index of the loop
-	/// @param loop_body The body of the loop
-	///
-	/// This is equivalent to:
-	///
-	/// for (size_t i = start; i < end; i++) {
-	///		 loop_body();
-	/// }
-	template <typename Func, typename arg_type = extract_argument_t<Func>>
-		requires(std::is_invocable_r_v<void, Func, arg_type> && std::is_integral_v<arg_type>) ||
-				std::is_invocable_r_v<void, Func>
-	void run_loop(size_t start, size_t end, Func&& loop_body) {
-		using induction_type = std::conditional_t<std::is_invocable_v<Func>, size_t, arg_type>;
-		std::counting_semaphore sem(0);
-		{
-			std::scoped_lock<std::mutex> lock(data_lock);
-			for (induction_type i = start; i < end; ++i) {
-				jobs.emplace([&, i]() {
-					if constexpr (std::is_invocable_v<Func>) {
-						loop_body();
-					} else {
-						loop_body(i);
-					}
-					sem.release();
-				});
+	void operator()() {
+		State* running = std::exchange(state, nullptr);
+		running->run();
+		running->release();
+	}
+
+   private:
+	State* state;
+};
+
+/// @brief Handle to the eventual result of a task added with ThreadPool::submit
+///
+/// Like std::future, a TaskFuture is move-only, get() can be called once, and only one thread may wait on a
+/// given future at a time.
+template <typename R>
+class TaskFuture {
+   public:
+	TaskFuture() noexcept = default;
+	explicit TaskFuture(FutureState<R>* state) noexcept : state(state) {}
+	TaskFuture(TaskFuture&& other) noexcept : state(std::exchange(other.state, nullptr)) {}
+
+	TaskFuture& operator=(TaskFuture&& other) noexcept {
+		if (this != &other) {
+			if (state) {
+				state->release();
 			}
+			state = std::exchange(other.state, nullptr);
+		}
+		return *this;
+	}
+
+	~TaskFuture() {
+		if (state) {
+			state->release();
 		}
-		cv.notify_all();
-		for (size_t i = start; i < end; i++) {
-			sem.acquire();
+	}
+
+	/// @brief Whether the future refers to a task (false after get() or when default constructed)
+	bool valid() const noexcept {
+		return state != nullptr;
+	}
+
+	/// @brief Whether the result is available, without blocking
+	bool ready() const noexcept {
+		return state && state->ready();
+	}
+
+	/// @brief Block until the result is available
+	void wait() const {
+		check_valid();
+		FutureStateBase* states[] = {state};
+		FutureStateBase::wait_all(states);
+	}
+
+	/// @brief Wait for the task and return its result
+	/// @throws Whatever the task threw
+	/// @throws std::future_error with broken_promise if the task was destroyed without running
+	R get() {
+		wait();
+		TaskFuture consumed(std::move(*this));
+		return consumed.state->get();
+	}
+
+	/// @brief Block until every future is ready, with at most one kernel wait for all of them
+	friend void wait_all(std::span<TaskFuture> futures) {
+		std::vector<FutureStateBase*> states;
+		states.reserve(futures.size());
+		for (TaskFuture& future : futures) {
+			future.check_valid();
+			states.push_back(future.state);
 		}
+		FutureStateBase::wait_all(states);
 	}
 
    private:
-	struct Job {
-		Job(std::function<void()>&& job) : job(std::move(job)) {}
-		Job() = delete;
-		std::function<void()> job;
+	void check_valid() const {
+		if (!state) {
+			throw std::future_error(std::future_errc::no_state);
+		}
+	}
+
+	FutureState<R>* state = nullptr;
+};
+
+template <typename T = void>
+class AsyncTask;
+
+/// @brief Promise parts shared by every AsyncTask<T>
+///
+/// Coroutine frames are allocated through the promise, so they are recycled like task nodes.
+class AsyncTaskPromiseBase : public RecycledNode {
+   public:
+	/// @brief Resumes whoever awaited the task, by symmetric transfer (no stack growth)
+	struct FinalAwaiter {
+		bool await_ready() const noexcept {
+			return false;
+		}
+
+		template <typename Promise>
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+			return handle.promise().continuation;
+		}
+
+		void await_resume() const noexcept {}
 	};
 
-	void worker_loop() {
-		while (running.load()) {
-			std::unique_lock<std::mutex> lock(data_lock);
-			cv.wait(lock, [this] { return !jobs.empty() || !running.load(); });
-			if (!running.load()) {
-				return;
-			}
-			Job job = std::move(jobs.front());
-			jobs.pop();
-			lock.unlock();
-			job.job();
+	std::suspend_always initial_suspend() const noexcept {
+		return {};
+	}
+
+	FinalAwaiter final_suspend() const noexcept {
+		return {};
+	}
+
+	void unhandled_exception() noexcept {
+		error = std::current_exception();
+	}
+
+	std::coroutine_handle<> continuation = std::noop_coroutine();
+
+   protected:
+	void rethrow_if_failed() const {
+		if (error) {
+			std::rethrow_exception(error);
 		}
 	}
 
-	std::atomic<bool> running = true;
-	std::vector<std::thread> threads;
-	std::queue<Job> jobs;
-	std::mutex data_lock;
-	std::condition_variable cv;
+	std::exception_ptr error;
+};
+
+template <typename T>
+class AsyncTaskPromise : public AsyncTaskPromiseBase {
+   public:
+	AsyncTask<T> get_return_object() noexcept;
+
+	template <typename U = T>
+		requires std::is_constructible_v<T, U&&>
+	void return_value(U&& value) {
+		result.emplace(std::forward<U>(value));
+	}
+
+	/// @brief Move the result out, or rethrow the exception that ended the coroutine
+	T take() {
+		rethrow_if_failed();
+		return std::move(*result);
+	}
+
+   private:
+	std::optional<T> result;
+};
+
+template <>
+class AsyncTaskPromise<void> : public AsyncTaskPromiseBase {
+   public:
+	AsyncTask<void> get_return_object() noexcept;
+
+	void return_void() const noexcept {}
+
+	void take() const {
+		rethrow_if_failed();
+	}
 };
 
+/// @brief Lazily started coroutine producing a T, resumed wherever it last suspended
+///
+/// The body starts when the task is first awaited (or passed to sync_wait). It runs on the awaiting thread until
+/// it co_awaits something else, typically pool.schedule() to move onto a worker. Awaiting the task yields its
+/// result or rethrows its exception, and a finished task resumes its awaiter directly rather than through a queue.
+template <typename T>
+class [[nodiscard]] AsyncTask {
+   public:
+	using promise_type = AsyncTaskPromise<T>;
+
+	explicit AsyncTask(std::coroutine_handle<promise_type> handle) noexcept : handle(handle) {}
+
+	AsyncTask(AsyncTask&& other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+
+	AsyncTask& operator=(AsyncTask&& other) noexcept {
+		if (this != &other) {
+			if (handle) {
+				handle.destroy();
+			}
+			handle = std::exchange(other.handle, nullptr);
+		}
+		return *this;
+	}
+
+	AsyncTask(const AsyncTask&) = delete;
+	AsyncTask& operator=(const AsyncTask&) = delete;
+
+	/// @brief Destroy the coroutine frame (a task must not be destroyed while its body is running)
+	~AsyncTask() {
+		if (handle) {
+			handle.destroy();
+		}
+	}
+
+	bool await_ready() const noexcept {
+		return handle.done();
+	}
+
+	/// @brief Start (or continue waiting for) the body, which resumes the awaiting coroutine when it finishes
+	std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+		handle.promise().continuation = awaiting;
+		return handle;
+	}
+
+	/// @brief The result of the finished body, or its exception rethrown
+	T await_resume() {
+		return handle.promise().take();
+	}
+
+	/// @brief Awaitable that runs the task to completion without taking its result
+	auto when_ready() noexcept {
+		struct ReadyAwaiter {
+			bool await_ready() const noexcept {
+				return handle.done();
+			}
+
+			std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+				handle.promise().continuation = awaiting;
+				return handle;
+			}
+
+			void await_resume() const noexcept {}
+
+			std::coroutine_handle<promise_type> handle;
+		};
+		return ReadyAwaiter{handle};
+	}
+
+   private:
+	std::coroutine_handle<promise_type> handle;
+};
+
+template <typename T>
+AsyncTask<T> AsyncTaskPromise<T>::get_return_object() noexcept {
+	return AsyncTask<T>(std::coroutine_handle<AsyncTaskPromise<T>>::from_promise(*this));
+}
+
+inline AsyncTask<void> AsyncTaskPromise<void>::get_return_object() noexcept {
+	return AsyncTask<void>(std::coroutine_handle<AsyncTaskPromise<void>>::from_promise(*this));
+}
+
+/// @brief Counts down finished coroutines, then resumes a waiting coroutine or wakes a waiting thread
+class CompletionLatch {
+   public:
+	/// @param count The number of arrivals to wait for, including the awaiting coroutine if co_awaited
+	/// @param resume_awaiter Whether the latch is co_awaited rather than waited for with wait()
+	CompletionLatch(size_t count, bool resume_awaiter) : count(count), resume_awaiter(resume_awaiter) {}
+
+	/// @brief Count one arrival, the last one resumes the awaiter (or notifies wait())
+	void arrive() noexcept {
+		// A thread in wait() may return and destroy the latch as soon as the count hits zero
+		bool resume = resume_awaiter;
+		if (count.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+			if (resume) {
+				awaiter.resume();
+			} else {
+				count.notify_all();
+			}
+		}
+	}
+
+	/// @brief Block the calling thread until the count reaches zero
+	void wait() const noexcept {
+		for (size_t current; (current = count.load(std::memory_order_acquire)) != 0;) {
+			count.wait(current, std::memory_order_acquire);
+		}
+	}
+
+	/// @brief Suspend until the count reaches zero, the awaiting coroutine counts as one arrival
+	bool await_ready() const noexcept {
+		return false;
+	}
+
+	bool await_suspend(std::coroutine_handle<> awaiting) noexcept {
+		awaiter = awaiting;
+		return count.fetch_sub(1, std::memory_order_acq_rel) != 1;
+	}
+
+	void await_resume() const noexcept {}
+
+   private:
+	std::atomic<size_t> count;
+	const bool resume_awaiter;
+	std::coroutine_handle<> awaiter;
+};
+
+/// @brief Coroutine that waits for one AsyncTask and then arrives at a CompletionLatch
+class CompletionDriver {
+   public:
+	struct promise_type : RecycledNode {
+		CompletionDriver get_return_object() noexcept {
+			return CompletionDriver(std::coroutine_handle<promise_type>::from_promise(*this));
+		}
+
+		std::suspend_always initial_suspend() const noexcept {
+			return {};
+		}
+
+		auto final_suspend() const noexcept {
+			struct Arrive {
+				bool await_ready() const noexcept {
+					return false;
+				}
+
+				// The arrival may resume a coroutine that destroys this frame, so nothing touches it afterwards
+				void await_suspend(std::coroutine_handle<promise_type> handle) const noexcept {
+					handle.promise().latch->arrive();
+				}
+
+				void await_resume() const noexcept {}
+			};
+			return Arrive{};
+		}
+
+		void return_void() const noexcept {}
+
+		void unhandled_exception() const noexcept {
+			std::terminate();
+		}
+
+		CompletionLatch* latch = nullptr;
+	};
+
+	template <typename T>
+	static CompletionDriver wait_for(AsyncTask<T>& task) {
+		co_await task.when_ready();
+	}
+
+	CompletionDriver(CompletionDriver&& other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+
+	CompletionDriver(const CompletionDriver&) = delete;
+	CompletionDriver& operator=(const CompletionDriver&) = delete;
+
+	~CompletionDriver() {
+		if (handle) {
+			handle.destroy();
+		}
+	}
+
+	/// @brief Start waiting, arriving at latch once the task has finished
+	void start(CompletionLatch& latch) {
+		handle.promise().latch = &latch;
+		handle.resume();
+	}
+
+   private:
+	explicit CompletionDriver(std::coroutine_handle<promise_type> handle) noexcept : handle(handle) {}
+
+	std::coroutine_handle<promise_type> handle;
+};
+
+/// @brief The value when_all collects from an AsyncTask<T> (std::monostate for void)
+template <typename T>
+using WhenAllValue = std::conditional_t<std::is_void_v<T>, std::monostate, T>;
+
+template <typename T>
+WhenAllValue<T> take_when_all_value(AsyncTask<T>& task) {
+	if constexpr (std::is_void_v<T>) {
+		task.await_resume();
+		return {};
+	} else {
+		return task.await_resume();
+	}
+}
+
+/// @brief Run a task to completion on the calling thread's behalf, blocking it until the result is ready
+///
+/// The body starts on the calling thread. Meant for threads outside the pool (main, I/O threads); inside a
+/// coroutine, co_await the task instead so that no worker blocks.
+template <typename T>
+T sync_wait(AsyncTask<T> task) {
+	CompletionLatch latch(1, false);
+	CompletionDriver driver = CompletionDriver::wait_for(task);
+	driver.start(latch);
+	latch.wait();
+	return task.await_resume();
+}
+
+/// @brief Start every task and resume the awaiter once all have finished, with a tuple of their results
+///
+/// The tasks start one after the other on the awaiting thread, so each should co_await pool.schedule() to run
+/// in parallel. The coroutine resumes on the thread that finished the last task, and if any task threw, one of
+/// the exceptions is rethrown.
+template <typename... Ts>
+AsyncTask<std::tuple<WhenAllValue<Ts>...>> when_all(AsyncTask<Ts>... tasks) {
+	CompletionLatch latch(sizeof...(Ts) + 1, true);
+	std::array<CompletionDriver, sizeof...(Ts)> drivers{CompletionDriver::wait_for(tasks)...};
+	for (CompletionDriver& driver : drivers) {
+		driver.start(latch);
+	}
+	co_await latch;
+	co_return std::tuple<WhenAllValue<Ts>...>{take_when_all_value(tasks)...};
+}
+
+/// @brief when_all for a run-time number of tasks, resuming with their results in order
+template <typename T>
+AsyncTask<std::vector<WhenAllValue<T>>> when_all(std::vector<AsyncTask<T>> tasks) {
+	CompletionLatch latch(tasks.size() + 1, true);
+	std::vector<CompletionDriver> drivers;
+	drivers.reserve(tasks.size());
+	for (AsyncTask<T>& task : tasks) {
+		drivers.push_back(CompletionDriver::wait_for(task));
+	}
+	for (CompletionDriver& driver : drivers) {
+		driver.start(latch);
+	}
+	co_await latch;
+	std::vector<WhenAllValue<T>> results;
+	results.reserve(tasks.size());
+	for (AsyncTask<T>& task : tasks) {
+		results.push_back(take_when_all_value(task));
+	}
+	co_return results;
+}
+
+/// @brief Alignment that keeps independently written data on separate cache lines
+///
+/// std::hardware_destructive_interference_size where the standard library provides it, 64 otherwise. The
+/// standard value may follow -mtune, so define THREADPOOL_CACHE_LINE_SIZE to pin it when translation units of
+/// one program are built with different tuning flags.
+#if defined(THREADPOOL_CACHE_LINE_SIZE)
+inline constexpr size_t cache_line_size = THREADPOOL_CACHE_LINE_SIZE;
+#elif defined(__cpp_lib_hardware_interference_size)
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Winterference-size"
+#endif
+inline constexpr size_t cache_line_size = std::hardware_destructive_interference_size;
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#else
+inline constexpr size_t cache_line_size = 64;
+#endif
+
+/// @brief Alignment of the pool's hot shared state: its queues, its workers and the counters every job updates
+///
+/// Defining THREADPOOL_PACKED_LAYOUT drops it and packs those members back together, only so that
+/// bench/layout_bench.cpp can measure what the padding buys.
+#if defined(THREADPOOL_PACKED_LAYOUT)
+#define THREADPOOL_HOT_ALIGN
+#else
+#define THREADPOOL_HOT_ALIGN alignas(cache_line_size)
+#endif
+
+/// @brief Tell the CPU that the calling thread is spinning (x86 pause, ARM yield)
+inline void cpu_relax() noexcept {
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+	asm volatile("yield");
+#endif
+}
+
+/// @brief How long an idle worker keeps looking for work before it parks
+///
+/// An idle worker polls the queues spin times with a CPU pause in between, then yield times with
+/// std::this_thread::yield in between, and only then parks until a submitter wakes it. Spinning trades CPU time
+/// for wakeup latency on bursty workloads; {0, 0} parks straight away.
+struct IdlePolicy {
+	unsigned spin = 64;
+	unsigned yield = 4;
+};
+
+/// @brief When an elastic pool adds workers beyond its base size, and when it retires them again
+///
+/// With max_threads above zero the pool starts another worker (up to max_threads) once more than queue_depth
+/// tasks beyond one per worker have been outstanding for at least grow_after with no worker parked, and a worker above
+/// the base size exits after it has been parked for keep_alive. max_threads = 0 keeps the pool at a fixed size.
+struct ElasticPolicy {
+	size_t max_threads = 0;
+	size_t queue_depth = 32;
+	std::chrono::microseconds grow_after{1000};
+	std::chrono::milliseconds keep_alive{10000};
+};
+
+/// @brief How a pool runs the tasks added with schedule_after and schedule_every
+///
+/// Deadlines are rounded up to a whole tick. By default the timers need no thread of their own: one parked
+/// worker parks with a timeout at the next deadline, and busy workers check for due timers between tasks. With
+/// dedicated_thread a timer thread waits for the deadlines instead, so timers stay on time while every worker is
+/// busy with long tasks.
+struct TimerPolicy {
+	std::chrono::microseconds tick{1000};
+	bool dedicated_thread = false;
+};
+
+/// @brief Double-ended queue in a single growable ring buffer
+///
+/// Unlike std::deque it keeps its storage when it empties, so a queue that has reached its working size stops
+/// allocating. T must be default constructible and move assignable; popped slots are reset to T().
+template <typename T>
+class RingDeque {
+   public:
+	bool empty() const noexcept {
+		return count == 0;
+	}
+
+	size_t size() const noexcept {
+		return count;
+	}
+
+	template <typename... Args>
+	void emplace_back(Args&&... args) {
+		T item(std::forward<Args>(args)...);
+		if (count == slots.size()) {
+			grow(std::max<size_t>(slots.size() * 2, 16));
+		}
+		slots[(head + count) & (slots.size() - 1)] = std::move(item);
+		count++;
+	}
+
+	T& front() {
+		return slots[head];
+	}
+
+	T& back() {
+		return slots[(head + count - 1) & (slots.size() - 1)];
+	}
+
+	/// @brief Makes room for extra more items, so that pushing them neither allocates nor throws
+	void reserve(size_t extra) {
+		if (count + extra > slots.size()) {
+			grow(std::bit_ceil(count + extra));
+		}
+	}
+
+	/// @brief The i-th item from the front
+	T& operator[](size_t i) {
+		return slots[(head + i) & (slots.size() - 1)];
+	}
+
+	void pop_front() {
+		slots[head] = T();
+		head = (head + 1) & (slots.size() - 1);
+		count--;
+	}
+
+	void pop_back() {
+		back() = T();
+		count--;
+	}
+
+   private:
+	void grow(size_t capacity) {
+		std::vector<T> larger(capacity);
+		for (size_t i = 0; i < count; i++) {
+			larger[i] = std::move(slots[(head + i) & (slots.size() - 1)]);
+		}
+		slots = std::move(larger);
+		head = 0;
+	}
+
+	std::vector<T> slots;  // power of two size
+	size_t head = 0;
+	size_t count = 0;
+};
+
+/// @brief Unbounded FIFO queue behind a mutex, starting on a cache line of its own
+template <typename T>
+class THREADPOOL_HOT_ALIGN LockedQueue {
+   public:
+	/// @brief Push make() (never fails, the queue is unbounded)
+	template <typename Make>
+	bool try_emplace(Make&& make) {
+		std::scoped_lock<std::mutex> lock(queue_lock);
+		items.emplace_back(make());
+		size_hint.store(items.size(), std::memory_order_relaxed);
+		return true;
+	}
+
+	/// @brief Push make(i) for i in [0, count) under a single lock acquisition
+	/// @return The number of items pushed, always count
+	template <typename Make>
+	size_t try_emplace_bulk(size_t count, Make&& make) {
+		std::scoped_lock<std::mutex> lock(queue_lock);
+		items.reserve(count);
+		try {
+			for (size_t i = 0; i < count; i++) {
+				items.emplace_back(make(i));
+			}
+		} catch (...) {
+			// The items made before the exception stay queued
+			size_hint.store(items.size(), std::memory_order_relaxed);
+			throw;
+		}
+		size_hint.store(items.size(), std::memory_order_relaxed);
+		return count;
+	}
+
+	std::optional<T> try_pop() {
+		if (empty()) {
+			return std::nullopt;
+		}
+		std::scoped_lock<std::mutex> lock(queue_lock);
+		if (items.empty()) {
+			return std::nullopt;
+		}
+		T item = std::move(items.front());
+		items.pop_front();
+		size_hint.store(items.size(), std::memory_order_relaxed);
+		return item;
+	}
+
+	/// @brief Whether the queue looked empty, without taking the lock
+	bool empty() const {
+		return size_hint.load(std::memory_order_relaxed) == 0;
+	}
+
+   private:
+	std::mutex queue_lock;
+	RingDeque<T> items;
+	std::atomic<size_t> size_hint = 0;
+};
+
+/// @brief Bounded lock-free FIFO ring (Vyukov), with one cache line per slot
+///
+/// Each slot carries a sequence number that tells producers and consumers whose turn it is, so a push or pop is
+/// one CAS on the shared position plus uncontended accesses to its own slot. With SingleProducer, only one
+/// thread may push at a time and pushing needs no CAS at all; any number of threads may pop either way.
+template <typename T, size_t Capacity, bool SingleProducer = false>
+class BoundedRing {
+	static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+	static_assert(std::is_nothrow_move_constructible_v<T> && std::is_nothrow_default_constructible_v<T>);
+
+   public:
+	BoundedRing() : slots(new Slot[Capacity]) {
+		for (size_t i = 0; i < Capacity; i++) {
+			slots[i].sequence.store(i, std::memory_order_relaxed);
+		}
+	}
+
+	BoundedRing(const BoundedRing&) = delete;
+	BoundedRing& operator=(const BoundedRing&) = delete;
+
+	~BoundedRing() {
+		while (try_pop()) {
+		}
+	}
+
+	/// @brief Push make() unless the ring is full
+	///
+	/// make() only runs once a slot is reserved. If it throws, the slot is filled with a default constructed T
+	/// and the exception propagates.
+	template <typename Make>
+	bool try_emplace(Make&& make) {
+		size_t position;
+		Slot* slot = reserve(position);
+		if (!slot) {
+			return false;
+		}
+		struct Publish {
+			~Publish() {
+				slot->sequence.store(position + 1, std::memory_order_release);
+			}
+			Slot* slot;
+			size_t position;
+		} publish{slot, position};
+		try {
+			::new (static_cast<void*>(slot->storage)) T(make());
+		} catch (...) {
+			::new (static_cast<void*>(slot->storage)) T();
+			throw;
+		}
+		return true;
+	}
+
+	/// @brief Push make(i) for i in [0, count) until the ring is full
+	/// @return The number of items pushed
+	template <typename Make>
+	size_t try_emplace_bulk(size_t count, Make&& make) {
+		size_t pushed = 0;
+		while (pushed < count && try_emplace([&] { return make(pushed); })) {
+			pushed++;
+		}
+		return pushed;
+	}
+
+	std::optional<T> try_pop() {
+		size_t position = dequeue_position.load(std::memory_order_relaxed);
+		Slot* slot;
+		for (;;) {
+			slot = &slots[position & (Capacity - 1)];
+			size_t sequence = slot->sequence.load(std::memory_order_acquire);
+			auto difference = static_cast<std::ptrdiff_t>(sequence - (position + 1));
+			if (difference == 0) {
+				if (dequeue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+					break;
+				}
+			} else if (difference < 0) {
+				return std::nullopt;
+			} else {
+				position = dequeue_position.load(std::memory_order_relaxed);
+			}
+		}
+		T* stored = std::launder(reinterpret_cast<T*>(slot->storage));
+		std::optional<T> item(std::move(*stored));
+		stored->~T();
+		slot->sequence.store(position + Capacity, std::memory_order_release);
+		return item;
+	}
+
+	/// @brief Whether the ring looked empty
+	bool empty() const {
+		size_t position = dequeue_position.load(std::memory_order_relaxed);
+		return slots[position & (Capacity - 1)].sequence.load(std::memory_order_acquire) != position + 1;
+	}
+
+   private:
+	struct alignas(cache_line_size) Slot {
+		std::atomic<size_t> sequence;
+		alignas(T) std::byte storage[sizeof(T)];
+	};
+
+	/// @brief Reserve the slot for the next push, or return nullptr if the ring is full
+	Slot* reserve(size_t& position) {
+		position = enqueue_position.load(std::memory_order_relaxed);
+		for (;;) {
+			Slot* slot = &slots[position & (Capacity - 1)];
+			size_t sequence = slot->sequence.load(std::memory_order_acquire);
+			auto difference = static_cast<std::ptrdiff_t>(sequence - position);
+			if (difference == 0) {
+				if constexpr (SingleProducer) {
+					enqueue_position.store(position + 1, std::memory_order_relaxed);
+					return slot;
+				} else if (enqueue_position.compare_exchange_weak(position, position + 1,
+																  std::memory_order_relaxed)) {
+					return slot;
+				}
+			} else if (difference < 0) {
+				return nullptr;
+			} else {
+				position = enqueue_position.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	std::unique_ptr<Slot[]> slots;
+	alignas(cache_line_size) std::atomic<size_t> enqueue_position = 0;
+	alignas(cache_line_size) std::atomic<size_t> dequeue_position = 0;
+};
+
+/// @brief Queue policy: unbounded ring buffer behind a mutex (the default)
+struct UnboundedQueue {
+	template <typename T>
+	using queue = LockedQueue<T>;
+};
+
+/// @brief Queue policy: bounded lock-free multi-producer multi-consumer ring
+///
+/// Submitting to a full queue blocks until a worker makes room (try_detach_task fails instead).
+template <size_t Capacity = 4096>
+struct BoundedQueue {
+	template <typename T>
+	using queue = BoundedRing<T, Capacity>;
+};
+
+/// @brief Queue policy: bounded lock-free ring whose push is a plain store for a single producer thread
+///
+/// Only one thread outside the pool may submit at a time. The pool's own threads (workers and the timer thread)
+/// never push to the ring: what they queue in the global lanes, such as tasks submitted from a task, the helper
+/// jobs of blocking calls, timer jobs and the jobs a retiring worker hands off, goes to an unbounded locked queue
+/// next to it.
+template <size_t Capacity = 4096>
+struct SingleProducerQueue {
+	template <typename T>
+	using queue = BoundedRing<T, Capacity, true>;
+
+	static constexpr bool single_producer = true;
+};
+
+/// @brief The parameter types of a call signature, as a std::tuple
+template <typename>
+struct call_parameters {};
+
+template <typename R, typename... Args>
+struct call_parameters<R (*)(Args...)> {
+	using type = std::tuple<Args...>;
+};
+
+template <typename R, typename... Args>
+struct call_parameters<R (*)(Args...) noexcept> {
+	using type = std::tuple<Args...>;
+};
+
+template <typename R, typename C, typename... Args>
+struct call_parameters<R (C::*)(Args...)> {
+	using type = std::tuple<Args...>;
+};
+
+template <typename R, typename C, typename... Args>
+struct call_parameters<R (C::*)(Args...) const> {
+	using type = std::tuple<Args...>;
+};
+
+template <typename R, typename C, typename... Args>
+struct call_parameters<R (C::*)(Args...) noexcept> {
+	using type = std::tuple<Args...>;
+};
+
+template <typename R, typename C, typename... Args>
+struct call_parameters<R (C::*)(Args...) const noexcept> {
+	using type = std::tuple<Args...>;
+};
+
+/// @brief The index type of a run_loop body taking one parameter, void for a body taking none
+template <typename>
+struct loop_index_of {};
+
+template <>
+struct loop_index_of<std::tuple<>> {
+	using type = void;
+};
+
+template <typename T>
+struct loop_index_of<std::tuple<T>> {
+	using type = std::remove_cvref_t<T>;
+};
+
+/// @brief Deduces the index type of a run_loop body from its call signature
+///
+/// Works for function pointers and for callables with a single non-template operator() (lambdas,
+/// std::function). A generic lambda, or any other callable without one signature, is called with size_t.
+template <typename Func, typename = void>
+struct loop_index {
+	using type = size_t;
+};
+
+template <typename Func>
+	requires std::is_pointer_v<std::decay_t<Func>>
+struct loop_index<Func> : loop_index_of<typename call_parameters<std::decay_t<Func>>::type> {};
+
+template <typename Func>
+struct loop_index<Func, std::void_t<decltype(&std::remove_cvref_t<Func>::operator())>>
+	: loop_index_of<typename call_parameters<decltype(&std::remove_cvref_t<Func>::operator())>::type> {};
+
+template <typename Func>
+using loop_index_t = typename loop_index<Func>::type;
+
+/// @brief How a thread pool distributes tasks among its workers
+enum class SchedulingMode {
+	/// Every task goes through one shared FIFO queue
+	global_queue,
+	/// Every worker owns a deque and idle workers steal from the others
+	work_stealing,
+};
+
+/// @brief How run_loop splits its index range among the workers
+enum class Schedule {
+	/// One contiguous block per worker
+	static_blocks,
+	/// Chunks of a fixed grain taken from a shared counter
+	dynamic,
+	/// Chunks proportional to the remaining work, never smaller than the grain
+	guided,
+	/// One block per participant, split in half only when another participant runs out of work, and eaten in
+	/// chunks sized from the measured cost per index (never smaller than the grain)
+	adaptive,
+};
+
+/// @brief What a blocking call does with the rest of its batch once one of its tasks has thrown
+enum class OnError {
+	/// Run every remaining task, then rethrow the first exception
+	finish,
+	/// Skip the tasks (and loop chunks) that have not started yet, then rethrow the first exception
+	cancel,
+};
+
+/// @brief CPUs grouped by NUMA node
+///
+/// On Linux this is read from /sys/devices/system/node and limited to the CPUs the process may run on. Elsewhere,
+/// or when /sys is unavailable, it is a single node holding every CPU. Nodes are numbered from 0 in the order
+/// found, which need not match the kernel's node ids when some nodes have no usable CPU.
+struct CpuTopology {
+	std::vector<std::vector<unsigned>> nodes;
+
+	/// @brief The topology of this machine, detected on first use
+	static const CpuTopology& system() {
+		static const CpuTopology topology = detect();
+		return topology;
+	}
+
+	/// @brief The node that a CPU belongs to (node 0 for unknown CPUs)
+	size_t node_of(unsigned cpu) const {
+		for (size_t node = 0; node < nodes.size(); node++) {
+			if (std::find(nodes[node].begin(), nodes[node].end(), cpu) != nodes[node].end()) {
+				return node;
+			}
+		}
+		return 0;
+	}
+
+	/// @brief Parse a Linux CPU or node list such as "0-3,8-11"
+	static std::vector<unsigned> parse_list(const std::string& list) {
+		std::vector<unsigned> values;
+		size_t position = 0;
+		while (position < list.size()) {
+			size_t comma = std::min(list.find(',', position), list.size());
+			std::string item = list.substr(position, comma - position);
+			position = comma + 1;
+			if (item.empty() || item.find_first_not_of("0123456789-\n ") != std::string::npos) {
+				continue;
+			}
+			size_t dash = item.find('-');
+			unsigned first = static_cast<unsigned>(std::stoul(item.substr(0, dash)));
+			unsigned last = dash == std::string::npos ? first : static_cast<unsigned>(std::stoul(item.substr(dash + 1)));
+			for (unsigned value = first; value <= last; value++) {
+				values.push_back(value);
+			}
+		}
+		return values;
+	}
+
+   private:
+	static CpuTopology detect() {
+		CpuTopology topology;
+#if defined(__linux__)
+		cpu_set_t allowed;
+		CPU_ZERO(&allowed);
+		bool have_mask = sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+		std::ifstream online("/sys/devices/system/node/online");
+		std::string node_list;
+		if (online && std::getline(online, node_list)) {
+			for (unsigned node : parse_list(node_list)) {
+				std::ifstream cpu_file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+				std::string cpu_list;
+				if (!cpu_file || !std::getline(cpu_file, cpu_list)) {
+					continue;
+				}
+				std::vector<unsigned> usable;
+				for (unsigned cpu : parse_list(cpu_list)) {
+					if (!have_mask || (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed))) {
+						usable.push_back(cpu);
+					}
+				}
+				if (!usable.empty()) {
+					topology.nodes.push_back(std::move(usable));
+				}
+			}
+		}
+#endif
+		if (topology.nodes.empty()) {
+			std::vector<unsigned> cpus(std::max(1u, std::thread::hardware_concurrency()));
+			for (unsigned cpu = 0; cpu < cpus.size(); cpu++) {
+				cpus[cpu] = cpu;
+			}
+			topology.nodes.push_back(std::move(cpus));
+		}
+		return topology;
+	}
+};
+
+/// @brief Restrict the calling thread to a set of CPUs (does nothing where unsupported)
+inline void pin_current_thread(const std::vector<unsigned>& cpus) {
+#if defined(__linux__)
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for (unsigned cpu : cpus) {
+		if (cpu < CPU_SETSIZE) {
+			CPU_SET(cpu, &set);
+		}
+	}
+	pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+	(void)cpus;
+#endif
+}
+
+/// @brief How a thread pool places its workers on the machine
+enum class Placement {
+	/// Let the OS scheduler move workers freely
+	none,
+	/// Pin each worker to a single CPU, taken in turn from Affinity::cpus
+	pin_cpus,
+	/// Spread workers round-robin over the NUMA nodes, each free to run on any CPU of its node
+	numa_nodes,
+};
+
+/// @brief Worker placement, applied to every worker the pool starts (in the constructor and in reset())
+struct Affinity {
+	Placement placement = Placement::none;
+	/// CPUs for Placement::pin_cpus in assignment order; empty means every CPU, node by node
+	std::vector<unsigned> cpus;
+};
+
+/// @brief Counter of outstanding work that wakes its waiters once, when it drops to zero
+///
+/// Call add() before starting work and done() when it finishes (TaskOptions::group does both for a detached
+/// task), then wait() or BasicThreadPool::wait(). A group created with a parent counts as one piece of the
+/// parent's work whenever it has work of its own, so groups nest. add() must not race with the count dropping to
+/// zero while someone waits, as with std::latch: add before handing out the work.
+class WaitGroup {
+   public:
+	/// @param count Initial amount of outstanding work
+	explicit WaitGroup(uint32_t count = 0) : count(count) {}
+
+	/// @param parent The group that waits for this one as well
+	/// @param count Initial amount of outstanding work
+	WaitGroup(WaitGroup& parent, uint32_t count) : parent(&parent) {
+		add(count);
+	}
+
+	WaitGroup(const WaitGroup&) = delete;
+	WaitGroup& operator=(const WaitGroup&) = delete;
+
+	/// @brief Add outstanding work
+	void add(uint32_t amount = 1) {
+		if (count.fetch_add(amount, std::memory_order_relaxed) == 0 && parent && amount != 0) {
+			parent->add();
+		}
+	}
+
+	/// @brief Mark one piece of work finished, waking the waiters if it was the last
+	void done() {
+		// A waiter may return and destroy the group as soon as the count hits zero
+		WaitGroup* parent_group = parent;
+		if (count.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+			count.notify_all();
+			if (parent_group) {
+				parent_group->done();
+			}
+		}
+	}
+
+	/// @brief Whether all work added so far has finished
+	bool is_done() const {
+		return count.load(std::memory_order_acquire) == 0;
+	}
+
+	/// @brief Block until all work has finished (on a pool worker, prefer BasicThreadPool::wait)
+	void wait() const {
+		for (uint32_t current; (current = count.load(std::memory_order_acquire)) != 0;) {
+			count.wait(current, std::memory_order_acquire);
+		}
+	}
+
+   private:
+	template <typename QueuePolicy, bool CollectStats>
+	friend class BasicThreadPool;
+
+	std::atomic<uint32_t> count = 0;
+	WaitGroup* const parent = nullptr;
+};
+
+/// @brief What BasicThreadPool::shutdown does with the tasks still queued
+enum class Shutdown {
+	/// Run every queued task (and whatever they add) before stopping
+	drain,
+	/// Drop the queued tasks, only waiting for the running ones
+	cancel_pending,
+};
+
+/// @brief Global queue lanes, served in this order
+enum class Priority { high, normal, background };
+
+/// @brief Per-task scheduling hints for detach_task and submit
+struct TaskOptions {
+	/// The lane to queue the task in
+	Priority priority = Priority::normal;
+	/// A group to add the task to, marked done once the task has run
+	WaitGroup* group = nullptr;
+	/// Queue a normal priority task for the workers of this NUMA node (modulo numa_nodes()). Ignored without an
+	/// Affinity.
+	std::optional<size_t> numa_node = std::nullopt;
+	/// Queue the task for this worker (modulo size()), the only one that runs it, so that the data it works on
+	/// stays in that worker's cache. Takes precedence over priority and numa_node. If the worker retires first,
+	/// the task moves to the global queue.
+	std::optional<size_t> worker = std::nullopt;
+	/// Name of the task in a trace (see start_tracing), must stay valid until the trace has been written
+	const char* label = nullptr;
+	/// Skip the task, destroying it without running, if a stop has been requested by the time a worker picks it
+	/// up. A task that takes a std::stop_token gets one that is stopped once this one or the pool is. Ignored by
+	/// schedule(), whose coroutine has to be resumed.
+	std::stop_token stop_token = {};
+};
+
+/// @brief A reusable dependency graph of tasks, run with BasicThreadPool::run_graph
+///
+/// Build the graph once with add_node and add_edge, then run it as often as needed: a run resets the node
+/// counters in place and allocates nothing. A graph must not be changed, or run again, while a run is in progress.
+class TaskGraph {
+   public:
+	using NodeId = uint32_t;
+
+	/// @brief Add a node
+	/// @param work What the node runs, any move constructible void() callable (called once per run)
+	/// @return The id of the new node, for add_edge
+	template <typename Func>
+		requires std::is_invocable_v<std::decay_t<Func>&> && std::is_move_constructible_v<std::decay_t<Func>>
+	NodeId add_node(Func&& work) {
+		nodes.emplace_back(std::forward<Func>(work));
+		checked = false;
+		return static_cast<NodeId>(nodes.size() - 1);
+	}
+
+	/// @brief Make one node wait for another
+	/// @param before The node that has to finish first
+	/// @param after The node that waits for it
+	void add_edge(NodeId before, NodeId after) {
+		if (before >= nodes.size() || after >= nodes.size()) {
+			throw std::out_of_range("TaskGraph::add_edge: no such node");
+		}
+		nodes[before].successors.push_back(after);
+		nodes[after].predecessors++;
+		checked = false;
+	}
+
+	/// @brief Get the number of nodes
+	size_t size() const {
+		return nodes.size();
+	}
+
+   private:
+	template <typename QueuePolicy, bool CollectStats>
+	friend class BasicThreadPool;
+
+	struct Node {
+		template <typename Func>
+		explicit Node(Func&& work) : work(std::forward<Func>(work)) {}
+
+		InplaceTask<THREADPOOL_TASK_BUFFER_SIZE> work;
+		std::vector<NodeId> successors;
+		uint32_t predecessors = 0;
+		/// Predecessors that have not finished yet in the current run
+		std::atomic<uint32_t> pending = 0;
+	};
+
+	/// @brief Find the roots and reject cycles, once after every change to the graph
+	/// @throws std::invalid_argument if the graph has a cycle
+	void check() {
+		if (checked) {
+			return;
+		}
+		std::vector<uint32_t> waiting(nodes.size());
+		std::vector<NodeId> ready;
+		for (NodeId id = 0; id < nodes.size(); id++) {
+			waiting[id] = nodes[id].predecessors;
+			if (waiting[id] == 0) {
+				ready.push_back(id);
+			}
+		}
+		roots = ready;
+		size_t visited = 0;
+		while (!ready.empty()) {
+			NodeId id = ready.back();
+			ready.pop_back();
+			visited++;
+			for (NodeId successor : nodes[id].successors) {
+				if (--waiting[successor] == 0) {
+					ready.push_back(successor);
+				}
+			}
+		}
+		if (visited != nodes.size()) {
+			throw std::invalid_argument("TaskGraph: the graph has a cycle");
+		}
+		checked = true;
+	}
+
+	std::deque<Node> nodes;
+	std::vector<NodeId> roots;
+	bool checked = true;
+	/// Nodes that have not finished yet in the current run
+	WaitGroup remaining;
+};
+
+/// @brief One traced span: a task, or a blocking call on the thread that made it
+struct TraceEvent {
+	const char* label = nullptr;
+	int64_t begin_ns = 0;  // steady_clock
+	int64_t end_ns = 0;
+};
+
+/// @brief Fixed size ring of trace events written by one thread and readable by any other
+///
+/// Recording never blocks or allocates; once the ring is full the oldest events are overwritten. Readers use
+/// the pair of counters as a sequence lock and skip the events that were overwritten while they read them.
+class TraceRing {
+   public:
+	explicit TraceRing(size_t capacity) : slots(std::bit_ceil(std::max<size_t>(capacity, 1))) {}
+
+	/// @brief Records an event, only ever called from the ring's own thread
+	void record(const char* label, int64_t begin_ns, int64_t end_ns) noexcept {
+		uint64_t index = written.load(std::memory_order_relaxed);
+		started.store(index + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		Slot& slot = slots[index & (slots.size() - 1)];
+		slot.label.store(label, std::memory_order_relaxed);
+		slot.begin_ns.store(begin_ns, std::memory_order_relaxed);
+		slot.end_ns.store(end_ns, std::memory_order_relaxed);
+		written.store(index + 1, std::memory_order_release);
+	}
+
+	/// @brief Calls visit(const TraceEvent&) for every event still in the ring, oldest first
+	template <typename Visit>
+	void for_each(Visit&& visit) const {
+		uint64_t end = written.load(std::memory_order_acquire);
+		uint64_t begin = end > slots.size() ? end - slots.size() : 0;
+		for (uint64_t index = begin; index < end; index++) {
+			const Slot& slot = slots[index & (slots.size() - 1)];
+			TraceEvent event{slot.label.load(std::memory_order_relaxed), slot.begin_ns.load(std::memory_order_relaxed),
+							 slot.end_ns.load(std::memory_order_relaxed)};
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (started.load(std::memory_order_relaxed) > index + slots.size()) {
+				// The writer has lapped this slot while it was read
+				continue;
+			}
+			visit(event);
+		}
+	}
+
+   private:
+	struct Slot {
+		std::atomic<const char*> label = nullptr;
+		std::atomic<int64_t> begin_ns = 0;
+		std::atomic<int64_t> end_ns = 0;
+	};
+
+	std::vector<Slot> slots;
+	std::atomic<uint64_t> started = 0;  // events whose slot the writer has begun to overwrite
+	std::atomic<uint64_t> written = 0;  // events completely written
+};
+
+/// @brief Hierarchical timer wheel over integer ticks, with O(1) insert and remove
+///
+/// Four levels of 64 slots: level l holds the timers due within 64^(l+1) ticks of the current one, so a timer is
+/// moved down at most three times before it expires. Timers further out wait on an overflow list that is
+/// looked at every 64^4 ticks. Advancing skips straight to the next occupied slot. Not thread-safe.
+class TimerWheel {
+   public:
+	/// @brief A timer, linked into at most one slot at a time
+	struct Node {
+		Node* prev = nullptr;
+		Node* next = nullptr;
+		uint64_t due = 0;
+		size_t slot = 0;
+
+		bool linked() const noexcept {
+			return next != nullptr;
+		}
+	};
+
+	static constexpr size_t levels = 4;
+	static constexpr size_t slot_bits = 6;
+	static constexpr uint64_t never = UINT64_MAX;
+
+	TimerWheel() {
+		for (Node& head : heads) {
+			head.prev = head.next = &head;
+		}
+	}
+
+	TimerWheel(const TimerWheel&) = delete;
+	TimerWheel& operator=(const TimerWheel&) = delete;
+
+	/// @brief The last tick the wheel was advanced to
+	uint64_t now() const noexcept {
+		return current;
+	}
+
+	bool empty() const noexcept {
+		return count == 0;
+	}
+
+	/// @brief Links a node to expire at the first advance to due (or to the next tick if due has passed)
+	void insert(Node& node, uint64_t due) noexcept {
+		node.due = std::max(due, current + 1);
+		place(node);
+		count++;
+	}
+
+	void remove(Node& node) noexcept {
+		unlink(node);
+		count--;
+	}
+
+	/// @brief The next tick advance has to stop at, never when empty
+	///
+	/// Exact when the earliest timer is due within the current 64 ticks, otherwise the tick at which the slot
+	/// holding it is moved down a level.
+	uint64_t next_due() const noexcept {
+		if (count == 0) {
+			return never;
+		}
+		for (size_t level = 0; level < levels; level++) {
+			size_t shift = slot_bits * level;
+			uint64_t index = (current >> shift) & slot_mask;
+			uint64_t later = index == slot_mask ? 0 : occupied[level] & (~uint64_t{0} << (index + 1));
+			if (later != 0) {
+				uint64_t base = current >> (shift + slot_bits) << (shift + slot_bits);
+				return base + (static_cast<uint64_t>(std::countr_zero(later)) << shift);
+			}
+		}
+		return ((current >> (slot_bits * levels)) + 1) << (slot_bits * levels);
+	}
+
+	/// @brief Advances to tick to, calling expire(Node&) for every node due by then, already unlinked, in due order
+	///
+	/// expire may insert nodes again.
+	template <typename Expire>
+	void advance(uint64_t to, Expire&& expire) {
+		while (current < to) {
+			uint64_t next = next_due();
+			if (next > to) {
+				current = to;
+				return;
+			}
+			current = next;
+			// Move the timers now within reach down a level, from the top level to the bottom one
+			for (size_t level = levels; level > 0; level--) {
+				if ((current & ((uint64_t{1} << (slot_bits * level)) - 1)) == 0) {
+					redistribute(level == levels ? overflow
+												 : level * slots_per_level + ((current >> (slot_bits * level)) & slot_mask));
+				}
+			}
+			Node due;
+			take(current & slot_mask, due);
+			while (due.next != &due) {
+				Node& node = *due.next;
+				unlink(node);
+				count--;
+				expire(node);
+			}
+		}
+	}
+
+	/// @brief Unlinks every node, calling each(Node&) for it
+	template <typename Each>
+	void clear(Each&& each) {
+		for (size_t slot = 0; slot <= overflow; slot++) {
+			while (heads[slot].next != &heads[slot]) {
+				Node& node = *heads[slot].next;
+				remove(node);
+				each(node);
+			}
+		}
+	}
+
+   private:
+	static constexpr size_t slots_per_level = size_t{1} << slot_bits;
+	static constexpr uint64_t slot_mask = slots_per_level - 1;
+	static constexpr size_t overflow = levels * slots_per_level;
+
+	/// @brief Links a node into the lowest level whose range from the current tick covers its due tick
+	void place(Node& node) noexcept {
+		for (size_t level = 0; level < levels; level++) {
+			size_t shift = slot_bits * (level + 1);
+			if ((node.due >> shift) == (current >> shift)) {
+				link(node, level * slots_per_level + ((node.due >> (shift - slot_bits)) & slot_mask));
+				return;
+			}
+		}
+		link(node, overflow);
+	}
+
+	void link(Node& node, size_t slot) noexcept {
+		Node& head = heads[slot];
+		node.prev = head.prev;
+		node.next = &head;
+		head.prev->next = &node;
+		head.prev = &node;
+		node.slot = slot;
+		if (slot != overflow) {
+			occupied[slot / slots_per_level] |= uint64_t{1} << (slot & slot_mask);
+		}
+	}
+
+	void unlink(Node& node) noexcept {
+		node.prev->next = node.next;
+		node.next->prev = node.prev;
+		node.prev = node.next = nullptr;
+		Node& head = heads[node.slot];
+		if (head.next == &head && node.slot != overflow) {
+			occupied[node.slot / slots_per_level] &= ~(uint64_t{1} << (node.slot & slot_mask));
+		}
+	}
+
+	/// @brief Moves the nodes of a slot onto the list headed by into
+	void take(size_t slot, Node& into) noexcept {
+		Node& head = heads[slot];
+		if (head.next == &head) {
+			into.prev = into.next = &into;
+			return;
+		}
+		into.next = head.next;
+		into.prev = head.prev;
+		into.next->prev = &into;
+		into.prev->next = &into;
+		head.prev = head.next = &head;
+		if (slot != overflow) {
+			occupied[slot / slots_per_level] &= ~(uint64_t{1} << (slot & slot_mask));
+		}
+	}
+
+	/// @brief Links the nodes of a slot again relative to the current tick
+	void redistribute(size_t slot) noexcept {
+		Node pending;
+		take(slot, pending);
+		while (pending.next != &pending) {
+			Node& node = *pending.next;
+			pending.next = node.next;
+			node.next->prev = &pending;
+			place(node);
+		}
+	}
+
+	std::array<Node, levels * slots_per_level + 1> heads;  // the last one is the overflow list
+	std::array<uint64_t, levels> occupied{};                // per level, which slots hold nodes
+	uint64_t current = 0;
+	size_t count = 0;
+};
+
+/// @brief Timers of one pool: a TimerWheel of scheduled tasks behind a mutex, and who waits for the next one
+///
+/// Deadlines are rounded up to a whole tick. An entry stays alive while it is in the wheel or queued to run
+/// (through self) and while a ScheduledTask refers to it. Without a dedicated timer thread, one parked worker at a
+/// time (the keeper) parks with a timeout at the next deadline; add and finish report who has to be woken when
+/// a timer becomes due before that.
+class TimerQueue {
+   public:
+	using Task = InplaceTask<THREADPOOL_TASK_BUFFER_SIZE>;
+
+	/// No waiter has to be woken
+	static constexpr size_t no_one = SIZE_MAX;
+	/// Some parked worker has to be woken to become the keeper
+	static constexpr size_t any_worker = SIZE_MAX - 1;
+	/// next_due_ns while no timer is scheduled
+	static constexpr int64_t never = INT64_MAX;
+
+	struct Entry : TimerWheel::Node {
+		Entry(Task&& task, uint64_t period) : task(std::move(task)), period(period) {}
+
+		Task task;
+		const uint64_t period;  // in ticks, 0 for a one-shot timer
+		// Guarded by the queue's lock
+		bool cancelled = false;
+		bool running = false;
+		bool done = false;
+		std::shared_ptr<Entry> self;
+		Entry* next_fired = nullptr;  // links the entries returned by expire
+	};
+
+	/// @brief The new entry (nullptr once the queue is closed) and who has to be woken for it
+	struct Added {
+		std::shared_ptr<Entry> entry;
+		size_t wake = no_one;
+	};
+
+	TimerQueue(std::chrono::nanoseconds tick, bool dedicated_thread)
+		: tick_ns(std::max<int64_t>(tick.count(), 1)), dedicated_thread(dedicated_thread), origin(steady_ns()) {}
+
+	/// @brief Schedules task to run at due_ns (steady_clock nanoseconds), then every period_ns if that is not 0
+	Added add(Task&& task, int64_t due_ns, int64_t period_ns) {
+		uint64_t period = period_ns == 0 ? 0 : std::max<uint64_t>(ticks_until(origin + period_ns), 1);
+		auto entry = std::make_shared<Entry>(std::move(task), period);
+		std::unique_lock<std::mutex> lock(mutex);
+		if (closed) {
+			lock.unlock();
+			return {};
+		}
+		arm(entry, ticks_until(due_ns));
+		size_t wake = wake_for_new_timer();
+		return {std::move(entry), wake};
+	}
+
+	/// @brief Lower bound on the steady_clock time the next timer is due at, never if there is none
+	int64_t next_due_ns() const noexcept {
+		return next_due.load(std::memory_order_relaxed);
+	}
+
+	/// @brief Advances the wheel to now_ns
+	/// @return The entries now due, linked through next_fired, each still holding itself through self
+	Entry* expire(int64_t now_ns) {
+		std::scoped_lock<std::mutex> lock(mutex);
+		if (closed) {
+			return nullptr;
+		}
+		Entry* first = nullptr;
+		Entry** last = &first;
+		wheel.advance(ticks_before(now_ns), [&](TimerWheel::Node& node) {
+			auto& entry = static_cast<Entry&>(node);
+			entry.next_fired = nullptr;
+			*last = &entry;
+			last = &entry.next_fired;
+		});
+		update_next_due();
+		return first;
+	}
+
+	/// @brief Called by the job of a fired entry before running its task
+	/// @return false if the task was cancelled after it fired
+	bool start(Entry& entry) {
+		std::scoped_lock<std::mutex> lock(mutex);
+		entry.running = !entry.cancelled && !closed;
+		return entry.running;
+	}
+
+	/// @brief Called by the job of a fired entry after running its task: re-arms a periodic timer
+	/// @return Who has to be woken for the re-armed timer
+	///
+	/// Runs missed while the task was late or running are skipped, keeping the timer on its original phase.
+	size_t finish(const std::shared_ptr<Entry>& entry) {
+		std::unique_lock<std::mutex> lock(mutex);
+		entry->running = false;
+		if (entry->period != 0 && !entry->cancelled && !closed) {
+			uint64_t now = std::max(wheel.now(), ticks_before(steady_ns()));
+			uint64_t next = entry->due + entry->period;
+			if (next <= now) {
+				next += (now - next) / entry->period * entry->period + entry->period;
+			}
+			arm(entry, next);
+			return wake_for_new_timer();
+		}
+		entry->done = true;
+		lock.unlock();
+		entry->task.reset();
+		return no_one;
+	}
+
+	/// @brief Stops an entry from running again
+	/// @return Whether a run was prevented
+	bool cancel(Entry& entry) {
+		std::unique_lock<std::mutex> lock(mutex);
+		if (entry.done || entry.cancelled) {
+			return false;
+		}
+		entry.cancelled = true;
+		if (entry.linked()) {
+			wheel.remove(entry);
+			update_next_due();
+			entry.done = true;
+			std::shared_ptr<Entry> keep = std::move(entry.self);
+			lock.unlock();
+			entry.task.reset();
+			return true;
+		}
+		// Fired: the run is prevented unless it has already started, in which case only later runs are
+		return !entry.running || entry.period != 0;
+	}
+
+	/// @brief Whether an entry is still to run (again)
+	bool pending(const Entry& entry) {
+		std::scoped_lock<std::mutex> lock(mutex);
+		return !entry.done && !entry.cancelled && !(entry.running && entry.period == 0);
+	}
+
+	/// @brief Makes a parked worker the keeper, unless there is one already
+	/// @return The steady_clock time to wake up at, or nullopt if the worker is not the keeper
+	std::optional<int64_t> claim_keeper(size_t worker) {
+		std::scoped_lock<std::mutex> lock(mutex);
+		if (dedicated_thread || closed || keeper != no_one || wheel.empty()) {
+			return std::nullopt;
+		}
+		uint64_t due = wheel.next_due();
+		if (time_of(due) == never) {
+			return std::nullopt;
+		}
+		keeper = worker;
+		waiter_tick = due;
+		return time_of(due);
+	}
+
+	void release_keeper(size_t worker) {
+		std::scoped_lock<std::mutex> lock(mutex);
+		if (keeper == worker) {
+			keeper = no_one;
+			waiter_tick = TimerWheel::never;
+		}
+	}
+
+	/// @brief Blocks the dedicated timer thread until a timer is due
+	/// @return false once the queue is closed
+	bool wait_until_due() {
+		std::unique_lock<std::mutex> lock(mutex);
+		while (!closed) {
+			uint64_t due = wheel.next_due();
+			if (due != TimerWheel::never && due <= ticks_before(steady_ns())) {
+				waiter_tick = TimerWheel::never;
+				return true;
+			}
+			waiter_tick = due;
+			if (time_of(due) == never) {
+				changed.wait(lock);
+			} else {
+				changed.wait_until(lock, std::chrono::steady_clock::time_point(std::chrono::nanoseconds(time_of(due))));
+			}
+		}
+		return false;
+	}
+
+	/// @brief Cancels every timer and refuses new ones, waking the dedicated timer thread to exit
+	void close() {
+		Entry* dropped = nullptr;
+		{
+			std::scoped_lock<std::mutex> lock(mutex);
+			closed = true;
+			wheel.clear([&](TimerWheel::Node& node) {
+				auto& entry = static_cast<Entry&>(node);
+				entry.done = true;
+				entry.next_fired = dropped;
+				dropped = &entry;
+			});
+			update_next_due();
+		}
+		changed.notify_all();
+		// Tasks are destroyed outside the lock, they may hold ScheduledTask handles of their own
+		while (dropped) {
+			std::shared_ptr<Entry> entry = std::move(dropped->self);
+			dropped = dropped->next_fired;
+			entry->task.reset();
+		}
+	}
+
+   private:
+	static int64_t steady_ns() noexcept {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+				   std::chrono::steady_clock::now().time_since_epoch())
+			.count();
+	}
+
+	/// @brief The first tick at or after a steady_clock time
+	uint64_t ticks_until(int64_t ns) const noexcept {
+		return ns <= origin ? 0 : static_cast<uint64_t>((ns - origin - 1) / tick_ns + 1);
+	}
+
+	/// @brief The last tick at or before a steady_clock time
+	uint64_t ticks_before(int64_t ns) const noexcept {
+		return ns <= origin ? 0 : static_cast<uint64_t>((ns - origin) / tick_ns);
+	}
+
+	int64_t time_of(uint64_t tick) const noexcept {
+		if (tick >= static_cast<uint64_t>((never - origin) / tick_ns)) {
+			return never;
+		}
+		return origin + static_cast<int64_t>(tick) * tick_ns;
+	}
+
+	/// @brief Links an entry into the wheel (lock held)
+	void arm(const std::shared_ptr<Entry>& entry, uint64_t due) {
+		wheel.insert(*entry, due);
+		entry->self = entry;
+		update_next_due();
+	}
+
+	/// @brief Who has to be woken after a timer was linked (lock held)
+	///
+	/// The keeper or the timer thread if the wheel now has to be advanced before they wake up by themselves, and
+	/// any parked worker if there is no keeper (which costs nothing while every worker is busy).
+	size_t wake_for_new_timer() {
+		if (wheel.next_due() >= waiter_tick) {
+			return no_one;
+		}
+		if (dedicated_thread) {
+			changed.notify_one();
+			return no_one;
+		}
+		return keeper != no_one ? keeper : any_worker;
+	}
+
+	void update_next_due() noexcept {
+		next_due.store(time_of(wheel.next_due()), std::memory_order_relaxed);
+	}
+
+	const int64_t tick_ns;
+	const bool dedicated_thread;
+	const int64_t origin;  // steady_clock nanoseconds at tick 0
+	alignas(cache_line_size) std::atomic<int64_t> next_due = never;
+	alignas(cache_line_size) std::mutex mutex;
+	TimerWheel wheel;
+	size_t keeper = no_one;                   // worker index of the keeper
+	uint64_t waiter_tick = TimerWheel::never;  // when the keeper or the timer thread wakes up by itself
+	std::condition_variable changed;          // wakes the dedicated timer thread
+	bool closed = false;
+};
+
+/// @brief Handle to a task added with schedule_after or schedule_every
+///
+/// Copies refer to the same task. Dropping the handle does not cancel the task.
+class ScheduledTask {
+   public:
+	ScheduledTask() = default;
+
+	/// @brief Stops the task from running again; a run already in progress finishes
+	/// @return Whether a run was prevented: false if a one-shot task has already started, the task was cancelled
+	/// before, or its pool has shut down
+	bool cancel() {
+		std::shared_ptr<TimerQueue> queue = owner.lock();
+		return queue && entry && queue->cancel(*entry);
+	}
+
+	/// @brief Whether the task is still to run (again)
+	bool pending() const {
+		std::shared_ptr<TimerQueue> queue = owner.lock();
+		return queue && entry && queue->pending(*entry);
+	}
+
+   private:
+	template <typename QueuePolicy, bool CollectStats>
+	friend class BasicThreadPool;
+
+	ScheduledTask(std::weak_ptr<TimerQueue> owner, std::shared_ptr<TimerQueue::Entry> entry)
+		: owner(std::move(owner)), entry(std::move(entry)) {}
+
+	std::weak_ptr<TimerQueue> owner;
+	std::shared_ptr<TimerQueue::Entry> entry;
+};
+
+/// @brief Counters of one worker
+///
+/// Counts and times are totals since the pool was created. queue_wait is a histogram of the time from queueing a
+/// task to starting it: bucket i counts waits shorter than queue_wait_bound(i) and at least the bound of the
+/// bucket below, and the last bucket also counts everything longer.
+struct WorkerStats {
+	static constexpr size_t queue_wait_buckets = 24;
+
+	/// @brief Upper bound of a queue_wait bucket, 1024 ns doubling with every bucket
+	static constexpr std::chrono::nanoseconds queue_wait_bound(size_t bucket) noexcept {
+		return std::chrono::nanoseconds(int64_t{1024} << bucket);
+	}
+
+	/// @brief The bucket a queue wait of ns nanoseconds falls in
+	static constexpr size_t queue_wait_bucket(int64_t ns) noexcept {
+		size_t bucket = ns < 0 ? 0 : static_cast<size_t>(std::bit_width(static_cast<uint64_t>(ns) >> 10));
+		return std::min(bucket, queue_wait_buckets - 1);
+	}
+
+	uint64_t tasks_started = 0;
+	uint64_t tasks_executed = 0;
+	std::chrono::nanoseconds busy_time{0};
+	std::chrono::nanoseconds idle_time{0};
+	/// Time spent blocked on a contended deque lock, as owner or thief
+	std::chrono::nanoseconds lock_wait_time{0};
+	uint64_t steal_attempts = 0;
+	uint64_t steals = 0;
+	std::array<uint64_t, queue_wait_buckets> queue_wait{};
+	/// Jobs on the worker's deque when the snapshot was taken
+	size_t queued = 0;
+
+	WorkerStats& operator+=(const WorkerStats& other) noexcept {
+		tasks_started += other.tasks_started;
+		tasks_executed += other.tasks_executed;
+		busy_time += other.busy_time;
+		idle_time += other.idle_time;
+		lock_wait_time += other.lock_wait_time;
+		steal_attempts += other.steal_attempts;
+		steals += other.steals;
+		for (size_t i = 0; i < queue_wait_buckets; i++) {
+			queue_wait[i] += other.queue_wait[i];
+		}
+		queued += other.queued;
+		return *this;
+	}
+};
+
+/// @brief Snapshot of a pool's counters, see BasicThreadPool::stats
+///
+/// The counters are read one at a time while the pool keeps running, so totals can be off by the tasks that
+/// started or finished during the snapshot.
+struct PoolStats {
+	/// Indexed like the workers, including the slots of workers that have retired
+	std::vector<WorkerStats> workers;
+	size_t active_workers = 0;
+	size_t parked_workers = 0;
+	/// Tasks queued or running
+	size_t outstanding = 0;
+
+	/// @brief All workers added up
+	WorkerStats total() const {
+		WorkerStats sum;
+		for (const WorkerStats& worker : workers) {
+			sum += worker;
+		}
+		return sum;
+	}
+
+	/// @brief Tasks waiting in any queue, not yet started
+	size_t queued() const {
+		WorkerStats sum = total();
+		size_t running = static_cast<size_t>(sum.tasks_started - std::min(sum.tasks_started, sum.tasks_executed));
+		return outstanding - std::min(outstanding, running);
+	}
+};
+
+/// @brief Thread pool whose global queue is chosen by QueuePolicy
+///
+/// QueuePolicy is one of UnboundedQueue (the default), BoundedQueue<Capacity> or SingleProducerQueue<Capacity>.
+/// With CollectStats the workers keep the counters returned by stats(); without it none of them is compiled in.
+template <typename QueuePolicy = UnboundedQueue, bool CollectStats = false>
+class BasicThreadPool {
+   public:
+	/// @brief The type every task is stored as
+	using Task = InplaceTask<THREADPOOL_TASK_BUFFER_SIZE>;
+
+	/// @brief How many tasks a strand runs in a row before letting the pool's other queued work go first
+	static constexpr size_t strand_batch = 64;
+
+	/// @brief Upper bound on the number of threads in a pool
+	///
+	/// Worker slots are preallocated so that stealing never races with reset() growing the pool.
+	static constexpr size_t max_threads = 1024;
+
+	/// @brief Whether a task is called with a std::stop_token (see detach_task)
+	template <typename Func>
+	static constexpr bool takes_stop_token = std::is_invocable_v<std::decay_t<Func>&, std::stop_token>;
+
+	/// @brief The result type of submit(func, args...): func is passed a std::stop_token first if it takes one
+	template <typename Func, typename... Args>
+	using submit_result_t = typename std::conditional_t<
+		std::is_invocable_v<std::decay_t<Func>, std::stop_token, std::decay_t<Args>...>,
+		std::invoke_result<std::decay_t<Func>, std::stop_token, std::decay_t<Args>...>,
+		std::invoke_result<std::decay_t<Func>, std::decay_t<Args>...>>::type;
+
+	BasicThreadPool() {
+		reset(std::thread::hardware_concurrency());
+	}
+
+	/// @brief  Construct a thread pool with a specific number of threads
+	/// @param num_threads Number of threads for the pool
+	explicit BasicThreadPool(size_t num_threads) {
+		reset(num_threads);
+	}
+
+	/// @brief  Construct a thread pool with a specific number of threads and scheduling mode
+	/// @param num_threads Number of threads for the pool
+	/// @param mode How tasks are distributed among the workers
+	/// @param idle_policy How long idle workers spin before parking
+	/// @param affinity Where workers are placed, now and when reset() adds more
+	/// @param elastic Whether and how the pool grows beyond num_threads while its queues back up
+	/// @param timer_policy How the tasks added with schedule_after and schedule_every are run
+	BasicThreadPool(size_t num_threads, SchedulingMode mode, IdlePolicy idle_policy = {}, Affinity affinity = {},
+					ElasticPolicy elastic = {}, TimerPolicy timer_policy = {})
+		: mode(mode),
+		  idle_policy(idle_policy),
+		  affinity(std::move(affinity)),
+		  elastic(elastic),
+		  timers(std::make_shared<TimerQueue>(timer_policy.tick, timer_policy.dedicated_thread)),
+		  node_queues(this->affinity.placement == Placement::none ? 0 : CpuTopology::system().nodes.size()) {
+		reset(num_threads);
+		if (timer_policy.dedicated_thread) {
+			timer_thread = std::jthread([this] {
+				timer_pool = this;
+				while (timers->wait_until_due()) {
+					expire_timers();
+				}
+			});
+		}
+	}
+
+	/// @brief Stops the workers once their current tasks finish, dropping queued tasks and timers (see shutdown)
+	~BasicThreadPool() {
+		if (running.load(std::memory_order_relaxed)) {
+			stop_workers();
+		}
+	}
+
+	/// @brief  Reset the number of threads in the pool
+	/// @param num_threads Number of threads for the pool
+	/// @throws std::runtime_error if the number of threads is greater than max_threads
+	/// @throws std::logic_error if the pool has been shut down or the calling thread is one of its workers
+	///
+	/// Shrinking retires the highest numbered workers once their current task finishes; the jobs left on their
+	/// deques move to the global queue, and reset() returns after the retired threads have exited. With an
+	/// ElasticPolicy, num_threads becomes the size the pool shrinks back to when idle.
+	void reset(size_t num_threads) {
+		if (!running.load(std::memory_order_relaxed)) {
+			throw std::logic_error("Cannot reset a thread pool that has been shut down");
+		}
+		if (num_threads > max_threads) {
+			throw std::runtime_error("Thread pool size exceeds max_threads");
+		}
+		// The retired threads stay in threads until joined, so that a concurrent grow reusing their slot joins them
+		// first instead of handing their Worker to a second thread
+		struct Retired {
+			size_t slot;
+			uint32_t starts;
+			uint32_t exits;
+		};
+		std::vector<Retired> retired;
+		{
+			std::scoped_lock<std::mutex> lock(resize_lock);
+			base_size = num_threads;
+			size_t active = num_workers.load(std::memory_order_relaxed);
+			if (num_threads < active) {
+				check_not_worker("Shrinking reset");
+				num_workers.store(num_threads, std::memory_order_release);
+				for (size_t i = num_threads; i < active; i++) {
+					retired.push_back({i, workers[i]->starts, workers[i]->exits.load(std::memory_order_acquire)});
+					workers[i]->retire.store(true, std::memory_order_relaxed);
+					unpark(*workers[i]);
+				}
+			}
+			for (size_t i = active; i < num_threads; i++) {
+				start_worker(i);
+			}
+		}
+		// Wait without the lock, since the retiring workers finish their current task first
+		for (const Retired& worker : retired) {
+			workers[worker.slot]->exits.wait(worker.exits, std::memory_order_acquire);
+		}
+		std::scoped_lock<std::mutex> lock(resize_lock);
+		for (const Retired& worker : retired) {
+			// Unless a grow has already joined it and restarted the slot (thread ids may be reused, start counts not)
+			if (workers[worker.slot]->starts == worker.starts && threads[worker.slot].joinable()) {
+				threads[worker.slot].join();
+			}
+		}
+	}
+
+	/// @brief Stops the pool: no new tasks may be added once this has been called
+	/// @param mode Whether to run the queued tasks first or to drop them
+	/// @return The number of queued tasks that were dropped without running
+	/// @throws std::logic_error if called from a worker of this pool
+	///
+	/// Tasks already running always finish. Dropped tasks are destroyed, so their futures report
+	/// std::future_errc::broken_promise and their wait groups count them as done. A thread blocked in run_loop or
+	/// run_tasks finishes the batch itself, while run_graph throws broken_promise once the nodes it can no
+	/// longer run are skipped; their helper jobs are not counted as dropped.
+	///
+	/// Once shut down, every call that adds work - detach_task, submit, timers, strands and the blocking calls -
+	/// throws std::logic_error instead of queueing jobs that would never run.
+	size_t shutdown(Shutdown mode = Shutdown::drain) {
+		check_not_worker("shutdown");
+		if (!running.load(std::memory_order_relaxed)) {
+			return 0;
+		}
+		if (mode == Shutdown::drain) {
+			wait_idle();
+		}
+		return stop_workers();
+	}
+
+	/// @brief Runs queued tasks for at most timeout, then stops the pool, dropping the rest
+	/// @param timeout How long to keep draining the queues
+	/// @return The number of queued tasks that were dropped without running
+	/// @throws std::logic_error if called from a worker of this pool
+	///
+	/// Tasks still running at the timeout are joined, not interrupted.
+	template <typename Rep, typename Period>
+	size_t shutdown_for(std::chrono::duration<Rep, Period> timeout) {
+		check_not_worker("shutdown_for");
+		if (!running.load(std::memory_order_relaxed)) {
+			return 0;
+		}
+		wait_idle_for(timeout);
+		return stop_workers();
+	}
+
+	/// @brief Blocks until every queue is empty and no task is running
+	/// @throws std::logic_error if called from a worker of this pool
+	void wait_idle() {
+		check_not_worker("wait_idle");
+		std::unique_lock<std::mutex> lock(idle_lock);
+		idle_waiters.fetch_add(1);
+		idle_changed.wait(lock, [&] { return outstanding.load() == 0; });
+		idle_waiters.fetch_sub(1);
+	}
+
+	/// @brief Blocks until the pool is idle, as wait_idle, or until timeout has passed
+	/// @param timeout How long to wait at most
+	/// @return Whether the pool became idle
+	/// @throws std::logic_error if called from a worker of this pool
+	template <typename Rep, typename Period>
+	bool wait_idle_for(std::chrono::duration<Rep, Period> timeout) {
+		check_not_worker("wait_idle_for");
+		std::unique_lock<std::mutex> lock(idle_lock);
+		idle_waiters.fetch_add(1);
+		bool idle = idle_changed.wait_for(lock, timeout, [&] { return outstanding.load() == 0; });
+		idle_waiters.fetch_sub(1);
+		return idle;
+	}
+
+	/// @brief  Get the number of threads in the pool
+	size_t size() const {
+		return num_workers.load(std::memory_order_acquire);
+	}
+
+	/// @brief  Get the scheduling mode of the pool
+	SchedulingMode scheduling_mode() const {
+		return mode;
+	}
+
+	/// @brief  Get the number of NUMA nodes that workers are grouped by (1 without an Affinity)
+	size_t numa_nodes() const {
+		return std::max<size_t>(node_queues.size(), 1);
+	}
+
+	/// @brief The index of the calling worker of this pool, or nullopt on any other thread
+	///
+	/// Indices are below max_threads, and below size() unless the pool shrank while the caller was running.
+	/// Retired workers' indices are reused by the workers that replace them.
+	std::optional<size_t> worker_index() const noexcept {
+		if (current_pool != this) {
+			return std::nullopt;
+		}
+		return current_worker->index;
+	}
+
+	/// @brief One lazily constructed T per worker of a pool, and one per other thread that asks for one
+	///
+	/// Each copy is constructed by the first call to local() on its thread, so with the default first-touch
+	/// policy a pinned worker's copy ends up on the worker's NUMA node. Copies sit on separate cache lines.
+	/// local() may be called concurrently from any threads; each, combine and clear must not run concurrently with
+	/// it, e.g. they are called after the blocking call that used the copies has returned. Must not outlive the
+	/// pool.
+	template <typename T>
+	class Local {
+	   public:
+		explicit Local(BasicThreadPool& pool)
+			requires std::is_default_constructible_v<T>
+			: Local(pool, [] { return T(); }) {}
+
+		/// @param make Called by each thread on its first use to construct its copy, returning a T
+		Local(BasicThreadPool& pool, std::function<T()> make)
+			: pool(pool), make(std::move(make)), worker_copies(max_threads) {}
+
+		Local(const Local&) = delete;
+		Local& operator=(const Local&) = delete;
+
+		/// @brief The calling thread's copy, constructed on first use
+		T& local() {
+			if (std::optional<size_t> index = pool.worker_index()) {
+				std::unique_ptr<Copy>& copy = worker_copies[*index];
+				if (!copy) {
+					copy.reset(new Copy{make()});
+				}
+				return copy->value;
+			}
+			std::scoped_lock<std::mutex> lock(other_lock);
+			std::thread::id self = std::this_thread::get_id();
+			for (auto& [thread, copy] : other_copies) {
+				if (thread == self) {
+					return copy->value;
+				}
+			}
+			other_copies.emplace_back(self, std::unique_ptr<Copy>(new Copy{make()}));
+			return other_copies.back().second->value;
+		}
+
+		/// @brief Calls visit(T&) for every copy constructed so far, the workers' by index first
+		template <typename Visit>
+		void each(Visit&& visit) {
+			for (std::unique_ptr<Copy>& copy : worker_copies) {
+				if (copy) {
+					visit(copy->value);
+				}
+			}
+			for (auto& [thread, copy] : other_copies) {
+				visit(copy->value);
+			}
+		}
+
+		/// @brief Folds the copies with combine(T, T) -> T, in the order of each; a new copy if there is none
+		template <typename Combine>
+		T combine(Combine&& combine) {
+			std::optional<T> result;
+			each([&](T& value) {
+				if (result) {
+					result.emplace(combine(std::move(*result), value));
+				} else {
+					result.emplace(value);
+				}
+			});
+			return result ? std::move(*result) : make();
+		}
+
+		/// @brief The number of copies constructed so far
+		size_t size() const {
+			size_t count = static_cast<size_t>(
+				std::count_if(worker_copies.begin(), worker_copies.end(), [](const auto& copy) { return copy != nullptr; }));
+			return count + other_copies.size();
+		}
+
+		/// @brief Destroys every copy; the next local() constructs a new one
+		void clear() {
+			for (std::unique_ptr<Copy>& copy : worker_copies) {
+				copy.reset();
+			}
+			other_copies.clear();
+		}
+
+	   private:
+		struct alignas(cache_line_size) Copy {
+			T value;
+		};
+
+		BasicThreadPool& pool;
+		std::function<T()> make;
+		std::vector<std::unique_ptr<Copy>> worker_copies;  // indexed by worker, each written only by its worker
+		std::mutex other_lock;
+		std::vector<std::pair<std::thread::id, std::unique_ptr<Copy>>> other_copies;  // guarded by other_lock
+	};
+
+	/// @brief A serial queue on top of a pool: its tasks run one at a time, in the order they were added
+	///
+	/// Nothing waits for a task to finish, so serializing a subsystem through a strand blocks no worker, unlike
+	/// guarding it with a mutex. The strand queues one job on the pool while it has tasks; that job runs up to
+	/// strand_batch of them and queues itself again behind the pool's other work if more are left. Consecutive
+	/// tasks may run on different workers, unless the options pin the strand to one, and each task's effects
+	/// are visible to the next.
+	///
+	/// Copies share one queue. Queued tasks keep running after the last copy is dropped, but not after the pool
+	/// is destroyed: tasks still queued then are dropped.
+	class Strand {
+	   public:
+		/// @param options How the strand's job is queued: its priority, NUMA node, worker and label (group and
+		/// stop_token are ignored)
+		explicit Strand(BasicThreadPool& pool, TaskOptions options = {}) : state(std::make_shared<State>(pool)) {
+			state->options = std::move(options);
+			state->options.group = nullptr;
+			state->options.stop_token = {};
+		}
+
+		/// @brief Add a task to the strand
+		/// @param task The task to be added, any move constructible void() or void(std::stop_token) callable
+		template <typename Func>
+			requires(std::is_invocable_v<std::decay_t<Func>&> || takes_stop_token<Func>) &&
+					std::is_move_constructible_v<std::decay_t<Func>>
+		void detach_task(Func&& task) {
+			// Also when the strand's job is still queued, since the shutdown may have dropped it
+			state->pool.check_running();
+			{
+				std::scoped_lock<std::mutex> lock(state->lock);
+				state->tasks.emplace_back(make_task(std::forward<Func>(task)));
+				if (state->scheduled) {
+					return;
+				}
+				state->scheduled = true;
+			}
+			try {
+				state->pool.detach_task([state = state] { drain(state); }, state->options);
+			} catch (...) {
+				// The task stays queued, for the next detach_task to start
+				std::scoped_lock<std::mutex> lock(state->lock);
+				state->scheduled = false;
+				throw;
+			}
+		}
+
+		/// @brief Add a task to the strand and get a future for its result
+		/// @param func The callable to run, passed a std::stop_token before the arguments if it takes one
+		/// @param args The arguments to call it with (copied or moved into the task)
+		/// @return A future that becomes ready with the result, or with the exception the call threw
+		template <typename Func, typename... Args, typename R = submit_result_t<Func, Args...>>
+		[[nodiscard]] TaskFuture<R> submit(Func&& func, Args&&... args) {
+			return submit_call<R>(bind_call<R>({}, std::forward<Func>(func), std::forward<Args>(args)...),
+								  [&](auto&& task) { detach_task(std::move(task)); });
+		}
+
+		/// @brief The number of tasks waiting in the strand, not counting the one running
+		size_t pending() const {
+			std::scoped_lock<std::mutex> lock(state->lock);
+			return state->tasks.size();
+		}
+
+	   private:
+		struct State {
+			explicit State(BasicThreadPool& pool) : pool(pool) {}
+
+			BasicThreadPool& pool;
+			TaskOptions options;
+			mutable std::mutex lock;
+			RingDeque<Task> tasks;   // guarded by lock
+			bool scheduled = false;  // whether a job of the strand is queued or running, guarded by lock
+		};
+
+		/// @brief The strand's job: runs the queued tasks in order, requeueing itself after strand_batch of them
+		static void drain(const std::shared_ptr<State>& state) {
+			for (size_t i = 0; i < strand_batch; i++) {
+				Task task;
+				{
+					std::scoped_lock<std::mutex> lock(state->lock);
+					if (state->tasks.empty()) {
+						state->scheduled = false;
+						return;
+					}
+					task = std::move(state->tasks.front());
+					state->tasks.pop_front();
+				}
+				task();
+			}
+			{
+				std::scoped_lock<std::mutex> lock(state->lock);
+				if (state->tasks.empty()) {
+					state->scheduled = false;
+					return;
+				}
+			}
+			try {
+				state->pool.detach_task([state = state] { drain(state); }, state->options);
+			} catch (...) {
+				// Out of memory or shut down: the rest stays queued, for the next detach_task to start (or report)
+				std::scoped_lock<std::mutex> lock(state->lock);
+				state->scheduled = false;
+			}
+		}
+
+		std::shared_ptr<State> state;
+	};
+
+	/// @brief Snapshot of the pool's counters, only available with CollectStats
+	///
+	/// Cheap enough to poll from an exporter: it reads the counters with relaxed loads and briefly locks each
+	/// worker's deque to read its depth.
+	PoolStats stats()
+		requires CollectStats
+	{
+		PoolStats stats;
+		size_t slots = num_slots.load(std::memory_order_acquire);
+		stats.workers.reserve(slots);
+		for (size_t i = 0; i < slots; i++) {
+			Worker& worker = *workers[i];
+			WorkerStats& snapshot = stats.workers.emplace_back(worker.counters.snapshot());
+			std::scoped_lock<std::mutex> lock(worker.deque_lock);
+			snapshot.queued = worker.jobs.size();
+		}
+		stats.active_workers = num_workers.load(std::memory_order_relaxed);
+		stats.parked_workers = sleepers.load(std::memory_order_relaxed);
+		stats.outstanding = outstanding.load(std::memory_order_relaxed);
+		return stats;
+	}
+
+	/// @brief Starts recording a trace event for every task the workers run, and for every blocking call
+	/// @param events_per_worker Size of each worker's ring, once full the oldest events are overwritten
+	///
+	/// Events keep the task's TaskOptions::label, or the name of the blocking call they belong to. The rings
+	/// are allocated by the first call and kept, so tracing can be stopped and restarted cheaply; later calls
+	/// only size the rings of workers that did not have one yet.
+	void start_tracing(size_t events_per_worker = size_t{1} << 16) {
+		std::scoped_lock<std::mutex> resize(resize_lock);
+		std::scoped_lock<std::mutex> lock(trace_lock);
+		if (trace_capacity == 0) {
+			trace_capacity = std::max<size_t>(events_per_worker, 1);
+		}
+		for (size_t i = 0; i < num_slots.load(std::memory_order_relaxed); i++) {
+			attach_trace(i);
+		}
+		tracing.store(true, std::memory_order_relaxed);
+	}
+
+	/// @brief Stops recording, keeping the events recorded so far for write_trace
+	void stop_tracing() {
+		std::scoped_lock<std::mutex> resize(resize_lock);
+		std::scoped_lock<std::mutex> lock(trace_lock);
+		tracing.store(false, std::memory_order_relaxed);
+		for (size_t i = 0; i < num_slots.load(std::memory_order_relaxed); i++) {
+			workers[i]->trace.store(nullptr, std::memory_order_relaxed);
+		}
+	}
+
+	/// @brief Writes the recorded events as Chrome trace_event JSON
+	/// @param out Where to write, e.g. a file to open in chrome://tracing or ui.perfetto.dev
+	///
+	/// Can be called while tracing; a worker's events that are overwritten while they are written out are
+	/// skipped. Every worker is a thread of its own in the trace, followed by the threads outside the pool that
+	/// made blocking calls. Timestamps are relative to the first event.
+	void write_trace(std::ostream& out) {
+		std::scoped_lock<std::mutex> lock(trace_lock);
+		std::vector<std::pair<size_t, TraceEvent>> events;
+		for (size_t i = 0; i < trace_rings.size(); i++) {
+			if (trace_rings[i]) {
+				trace_rings[i]->for_each([&](const TraceEvent& event) { events.emplace_back(i, event); });
+			}
+		}
+		std::vector<std::thread::id> callers;
+		for (size_t i = 0; i < caller_events.size(); i++) {
+			auto& [id, event] = caller_events[i];
+			size_t caller = static_cast<size_t>(std::find(callers.begin(), callers.end(), id) - callers.begin());
+			if (caller == callers.size()) {
+				callers.push_back(id);
+			}
+			events.emplace_back(max_threads + caller, event);
+		}
+		int64_t origin = 0;
+		for (size_t i = 0; i < events.size(); i++) {
+			origin = i == 0 ? events[i].second.begin_ns : std::min(origin, events[i].second.begin_ns);
+		}
+		out << "{\"traceEvents\":[";
+		const char* separator = "\n";
+		auto name_thread = [&](size_t tid, const char* kind, size_t number) {
+			out << separator << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << tid
+				<< ",\"args\":{\"name\":\"" << kind << ' ' << number << "\"}}";
+			separator = ",\n";
+		};
+		for (size_t i = 0; i < trace_rings.size(); i++) {
+			if (trace_rings[i]) {
+				name_thread(i, "worker", i);
+			}
+		}
+		for (size_t i = 0; i < callers.size(); i++) {
+			name_thread(max_threads + i, "caller", i);
+		}
+		for (const auto& [tid, event] : events) {
+			out << separator << "{\"name\":";
+			write_json_string(out, event.label);
+			out << ",\"ph\":\"X\",\"pid\":0,\"tid\":" << tid << ",\"ts\":";
+			write_micros(out, event.begin_ns - origin);
+			out << ",\"dur\":";
+			write_micros(out, event.end_ns - event.begin_ns);
+			out << '}';
+			separator = ",\n";
+		}
+		out << "\n]}\n";
+	}
+
+	// ********** Non-blocking API **********
+
+	/// @brief Add a task to the thread pool
+	/// @param task The task to be added, any move constructible void() or void(std::stop_token) callable
+	///
+	/// A task taking a std::stop_token is passed one that is stopped once the pool stops (shutdown or destructor),
+	/// so that a long-running task can return early.
+	template <typename Func>
+		requires(std::is_invocable_v<std::decay_t<Func>&> || takes_stop_token<Func>) &&
+				std::is_move_constructible_v<std::decay_t<Func>>
+	void detach_task(Func&& task) {
+		push_jobs(1, [&](size_t) { return make_task(std::forward<Func>(task)); });
+	}
+
+	/// @brief Add a task to the thread pool with scheduling hints
+	/// @param task The task to be added, any move constructible void() or void(std::stop_token) callable
+	/// @param options Where to queue the task, and the token that cancels it
+	template <typename Func>
+		requires(std::is_invocable_v<std::decay_t<Func>&> || takes_stop_token<Func>) &&
+				std::is_move_constructible_v<std::decay_t<Func>>
+	void detach_task(Func&& task, const TaskOptions& options) {
+		// A task taking a std::stop_token is always wrapped, since stoppable is what passes it one
+		if (takes_stop_token<Func> || options.stop_token.stop_possible()) {
+			queue_grouped(stoppable(std::forward<Func>(task), options.stop_token), options);
+		} else if constexpr (!takes_stop_token<Func>) {
+			queue_grouped(std::forward<Func>(task), options);
+		}
+	}
+
+	/// @brief Add a task to the thread pool unless its queue is full
+	/// @param task The task to be added, any move constructible void() or void(std::stop_token) callable
+	/// @return false, without taking the task, if a bounded global queue is full
+	template <typename Func>
+		requires(std::is_invocable_v<std::decay_t<Func>&> || takes_stop_token<Func>) &&
+				std::is_move_constructible_v<std::decay_t<Func>>
+	bool try_detach_task(Func&& task) {
+		check_running();
+		if (local_worker()) {
+			detach_task(std::forward<Func>(task));
+			return true;
+		}
+		outstanding.fetch_add(1);
+		bool pushed = false;
+		try {
+			pushed = push_to_lane(Priority::normal, 1,
+								  [&](size_t) { return Job(make_task(std::forward<Func>(task))); }) == 1;
+		} catch (...) {
+			finish_jobs(1);
+			throw;
+		}
+		if (!pushed) {
+			finish_jobs(1);
+			return false;
+		}
+		wake_workers(1);
+		return true;
+	}
+
+	/// @brief Add a task to the thread pool and get a future for its result
+	/// @param func The callable to run, passed a std::stop_token before the arguments if it takes one
+	/// @param args The arguments to call it with (copied or moved into the task)
+	/// @return A future that becomes ready with the result, or with the exception the call threw
+	///
+	/// The callable and its result share one heap allocation, the task itself is stored inline.
+	template <typename Func, typename... Args, typename R = submit_result_t<Func, Args...>>
+		requires(!std::is_same_v<std::decay_t<Func>, TaskOptions>)
+	[[nodiscard]] TaskFuture<R> submit(Func&& func, Args&&... args) {
+		return submit_call<R>(bind_call<R>({}, std::forward<Func>(func), std::forward<Args>(args)...),
+							  [&](auto&& task) { detach_task(std::move(task)); });
+	}
+
+	/// @brief Add a task to the thread pool with scheduling hints and get a future for its result
+	/// @param options Where to queue the task, and the token that cancels it
+	/// @param func The callable to run, passed a std::stop_token before the arguments if it takes one
+	/// @param args The arguments to call it with (copied or moved into the task)
+	/// @return A future that becomes ready with the result, or with the exception the call threw
+	///
+	/// A task skipped because options.stop_token was stopped fails its future with
+	/// std::future_errc::broken_promise, like a task dropped at shutdown.
+	template <typename Func, typename... Args, typename R = submit_result_t<Func, Args...>>
+	[[nodiscard]] TaskFuture<R> submit(const TaskOptions& options, Func&& func, Args&&... args) {
+		return submit_call<R>(bind_call<R>(options.stop_token, std::forward<Func>(func), std::forward<Args>(args)...),
+							  [&](auto&& task) { detach_task(std::move(task), options); });
+	}
+
+	/// @brief Adds tasks to the thread pool
+	/// @param tasks A container of tasks to be added (not valid after this function returns)
+	void detach_tasks(std::span<std::function<void()>> tasks) {
+		push_jobs(tasks.size(), [&](size_t i) { return std::move(tasks[i]); });
+	}
+
+	/// @brief Adds the tasks make_task(0), ..., make_task(count - 1) to the thread pool
+	/// @param count Number of tasks
+	/// @param make_task Called once per index, in increasing order, returning a move constructible void() callable
+	///
+	/// The tasks are made straight into the queue, under one lock per queue, with no intermediate container.
+	template <typename Generator, typename Func = std::invoke_result_t<Generator&, size_t>>
+		requires std::is_invocable_v<std::decay_t<Func>&> && std::is_move_constructible_v<std::decay_t<Func>>
+	void detach_tasks(size_t count, Generator&& make_task) {
+		push_jobs(count, [&](size_t i) { return Task(make_task(i)); });
+	}
+
+	/// @brief Adds the tasks in [first, last) to the thread pool
+	/// @param first The first task, any void() callable (use std::make_move_iterator to move rather than copy)
+	/// @param last The end of the tasks
+	template <std::input_iterator It, std::sentinel_for<It> End>
+		requires(std::forward_iterator<It> || std::sized_sentinel_for<End, It>) && std::is_invocable_v<std::decay_t<std::iter_reference_t<It>>&> &&
+				 std::is_constructible_v<std::decay_t<std::iter_reference_t<It>>, std::iter_reference_t<It>>
+	void detach_tasks(It first, End last) {
+		size_t count = static_cast<size_t>(std::ranges::distance(first, last));
+		push_jobs(count, [&](size_t) { return Task(*first++); });
+	}
+
+	/// @brief Adds a range of tasks to the thread pool, moving them out of an rvalue range and copying otherwise
+	/// @param tasks A forward range of void() callables of any type
+	template <std::ranges::forward_range Range>
+		requires(!std::is_convertible_v<Range, std::span<std::function<void()>>>) &&
+				std::is_invocable_v<std::ranges::range_value_t<Range>&>
+	void detach_tasks(Range&& tasks) {
+		if constexpr (std::is_lvalue_reference_v<Range>) {
+			detach_tasks(std::ranges::begin(tasks), std::ranges::end(tasks));
+		} else {
+			detach_tasks(std::make_move_iterator(std::ranges::begin(tasks)),
+						 std::make_move_iterator(std::ranges::end(tasks)));
+		}
+	}
+
+	/// @brief Run a task once after a delay, without occupying a worker until then
+	/// @param delay How long to wait at least, rounded up to a whole TimerPolicy::tick
+	/// @param task Any move constructible void() callable
+	/// @return A handle to cancel the task with
+	/// @throws std::logic_error if the pool has been shut down
+	///
+	/// Once due, the task is queued in the Priority::high lane. Pending timers do not count as outstanding work for
+	/// wait_idle, and shutting the pool down cancels them.
+	template <typename Rep, typename Period, typename Func>
+		requires std::is_invocable_v<std::decay_t<Func>&> && std::is_move_constructible_v<std::decay_t<Func>>
+	ScheduledTask schedule_after(std::chrono::duration<Rep, Period> delay, Func&& task) {
+		return add_timer(timer_ns(delay), 0, Task(std::forward<Func>(task)));
+	}
+
+	/// @brief Run a task every period, the first time one period from now
+	/// @param period Time between the starts of two runs, rounded up to a whole TimerPolicy::tick
+	/// @param task Any move constructible void() callable, called once per run
+	/// @return A handle to cancel the task with
+	/// @throws std::logic_error if the pool has been shut down
+	///
+	/// Runs keep to the original phase and never overlap: the next run is armed once the current one returns,
+	/// skipping the runs it missed by being late or slow.
+	template <typename Rep, typename Period, typename Func>
+		requires std::is_invocable_v<std::decay_t<Func>&> && std::is_move_constructible_v<std::decay_t<Func>>
+	ScheduledTask schedule_every(std::chrono::duration<Rep, Period> period, Func&& task) {
+		int64_t period_ns = std::max<int64_t>(timer_ns(period), 1);
+		return add_timer(period_ns, period_ns, Task(std::forward<Func>(task)));
+	}
+
+	/// @brief Awaitable that resumes the awaiting coroutine on a worker of this pool
+	/// @param options Where to queue the resumption
+	///
+	/// The coroutine handle itself is queued, stored inline in the job, so a hop costs no allocation. co_await
+	/// throws std::logic_error if the pool has been shut down. A resumption that shutdown drops still resumes the
+	/// coroutine, on the thread shutting the pool down, where co_await throws std::future_error with
+	/// std::future_errc::broken_promise, so that the frame is not leaked and whoever awaits it is not left hanging.
+	auto schedule(const TaskOptions& options = {}) noexcept {
+		struct ScheduleAwaiter {
+			bool await_ready() const noexcept {
+				return false;
+			}
+
+			void await_suspend(std::coroutine_handle<> handle) {
+				const bool* outer = std::exchange(Resumption::queueing, &dropped);
+				try {
+					pool->detach_task(Resumption(handle, dropped), options);
+				} catch (...) {
+					// Throwing resumes the coroutine, so a job destroyed while being queued must not as well
+					Resumption::queueing = outer;
+					throw;
+				}
+				Resumption::queueing = outer;
+			}
+
+			void await_resume() const {
+				if (dropped) {
+					throw std::future_error(std::future_errc::broken_promise);
+				}
+			}
+
+			BasicThreadPool* pool;
+			TaskOptions options;
+			bool dropped = false;
+		};
+		ScheduleAwaiter awaiter{this, options};
+		awaiter.options.stop_token = {};
+		return awaiter;
+	}
+
+	// ********** Blocking API **********
+
+	/// @brief Waits until the work of every given group is done
+	/// @param groups The groups to wait for
+	///
+	/// Called from a worker of this pool, it runs queued tasks while it waits instead of blocking the worker.
+	template <typename... Groups>
+		requires(std::is_same_v<Groups, WaitGroup> && ...)
+	void wait(const Groups&... groups) {
+		(wait_helping(groups), ...);
+	}
+
+	/// @brief Adds tasks to the thread pool and waits for them to finish
+	/// @param tasks A container of tasks to be added (not valid after this function returns)
+	/// @param on_error Whether the tasks not started yet still run once one has thrown
+	/// @throws The first exception thrown by a task, once the batch has drained
+	void run_tasks(std::span<std::function<void()>> tasks, OnError on_error = OnError::finish) {
+		run_chunks("run_tasks", 0, tasks.size(), Schedule::dynamic, 1, on_error,
+				   [&](size_t begin, size_t) { tasks[begin](); });
+	}
+
+	/// @brief Runs every node of a task graph, each once all of its predecessors have finished
+	/// @param graph The graph to run (not to be changed until this function returns)
+	/// @param on_error Whether the nodes not started yet still run once one has thrown
+	/// @throws std::invalid_argument if the graph has a cycle
+	/// @throws The first exception thrown by a node, once the graph has drained
+	///
+	/// The calling thread runs the first root itself. Whoever finishes a node's last predecessor runs that node
+	/// next and pushes the other nodes it made ready, which in work stealing mode lands them on its own deque.
+	void run_graph(TaskGraph& graph, OnError on_error = OnError::finish) {
+		graph.check();
+		if (graph.nodes.empty()) {
+			return;
+		}
+		for (auto& node : graph.nodes) {
+			node.pending.store(node.predecessors, std::memory_order_relaxed);
+		}
+		TracedCall traced(*this, "run_graph");
+		graph.remaining.add(static_cast<uint32_t>(graph.nodes.size()));
+		BatchStatus status(on_error);
+		push_jobs(
+			graph.roots.size() - 1, [&](size_t i) { return GraphJob(*this, graph, status, graph.roots[i + 1]); },
+			Priority::normal, "run_graph");
+		run_graph_nodes(graph, status, graph.roots.front());
+		wait_helping(graph.remaining);
+		status.rethrow();
+	}
+
+	/// @brief Adds tasks to the thread pool and waits for them to finish
+	/// @param start The start index of the loop
+	/// @param end The end index of the loop
+	/// @param loop_body The body of the loop, any callable taking one integral index or nothing
+	/// @param schedule How the indices are split among the workers
+	/// @param grain Smallest number of indices handed out at once by the dynamic, guided and adaptive schedules
+	/// @param on_error Whether the chunks not started yet still run once one has thrown
+	/// @throws The first exception thrown by loop_body, once the loop has drained
+	///
+	/// This is equivalent to:
+	///
+	/// for (size_t i = start; i < end; i++) {
+	///		 loop_body(i);
+	/// }
+	///
+	/// The index type is deduced from loop_body's signature (see loop_index). The body is called directly from
+	/// the loop over each chunk, so it can be inlined and vectorized.
+	template <typename Func, typename arg_type = loop_index_t<Func>>
+		requires(std::is_invocable_r_v<void, Func, arg_type> && std::is_integral_v<arg_type>) ||
+				std::is_invocable_r_v<void, Func>
+	void run_loop(size_t start, size_t end, Func&& loop_body, Schedule schedule = Schedule::static_blocks,
+				  size_t grain = 1, OnError on_error = OnError::finish) {
+		using induction_type = std::conditional_t<std::is_invocable_v<Func>, size_t, arg_type>;
+		run_chunks("run_loop", start, end, schedule, grain, on_error, [&](size_t chunk_begin, size_t chunk_end) {
+			for (size_t i = chunk_begin; i < chunk_end; i++) {
+				if constexpr (std::is_invocable_v<Func>) {
+					loop_body();
+				} else {
+					loop_body(static_cast<induction_type>(i));
+				}
+			}
+		});
+	}
+
+	/// @brief Splits a loop into sub-ranges, runs them on the thread pool and waits for them to finish
+	/// @param start The start index of the loop
+	/// @param end The end index of the loop
+	/// @param loop_body The body of the loop, called with disjoint [begin, end) sub-ranges covering [start, end)
+	/// @param schedule How the indices are split among the workers
+	/// @param grain Smallest number of indices handed out at once by the dynamic, guided and adaptive schedules
+	/// @param on_error Whether the sub-ranges not started yet still run once one has thrown
+	/// @throws The first exception thrown by loop_body, once the loop has drained
+	///
+	/// This is equivalent to:
+	///
+	/// loop_body(start, end);
+	template <typename Func>
+		requires std::is_invocable_r_v<void, Func, size_t, size_t>
+	void run_loop(size_t start, size_t end, Func&& loop_body, Schedule schedule = Schedule::static_blocks,
+				  size_t grain = 1, OnError on_error = OnError::finish) {
+		run_chunks("run_loop", start, end, schedule, grain, on_error, loop_body);
+	}
+
+	// ********** Parallel algorithms **********
+
+	/// @brief Reduces [first, last) with op, which must be associative
+	/// @param first The start of the input range
+	/// @param last The end of the input range
+	/// @param init The initial value, combined once with the reduction of the range
+	/// @param op The reduction, callable as op(T, T) and op(T, element)
+	/// @return init reduced with every element, in an unspecified grouping
+	///
+	/// Each participant reduces one contiguous block into its own cache line, and the calling thread combines
+	/// the partials in block order, so the grouping only depends on the pool size. A block starts from its first
+	/// element converted to T, since init is only combined once, so an element must be explicitly convertible to
+	/// T: an op that folds elements into an accumulator of another kind, such as op(size_t, const std::string&),
+	/// is not a reduction that can be split.
+	template <std::random_access_iterator It, typename T, typename BinaryOp>
+		requires std::constructible_from<T, std::iter_reference_t<It>>
+	T parallel_reduce(It first, It last, T init, BinaryOp op) {
+		size_t count = static_cast<size_t>(last - first);
+		size_t blocks = block_count(count);
+		std::vector<Padded<std::optional<T>>> partials(blocks);
+		run_blocks("parallel_reduce", count, blocks, [&](size_t block, size_t begin, size_t end) {
+			T partial = static_cast<T>(first[begin]);
+			for (size_t i = begin + 1; i < end; i++) {
+				partial = op(std::move(partial), first[i]);
+			}
+			partials[block].value = std::move(partial);
+		});
+		for (auto& partial : partials) {
+			if (partial.value) {
+				init = op(std::move(init), std::move(*partial.value));
+			}
+		}
+		return init;
+	}
+
+	/// @brief Writes op(element) for every element of [first, last) to the range starting at d_first
+	/// @param first The start of the input range
+	/// @param last The end of the input range
+	/// @param d_first The start of the output range (may equal first)
+	/// @param op The unary function to apply
+	/// @return The end of the output range
+	template <std::random_access_iterator It, std::random_access_iterator Out, typename UnaryOp>
+	Out parallel_transform(It first, It last, Out d_first, UnaryOp op, Schedule schedule = Schedule::static_blocks,
+						   size_t grain = 1) {
+		size_t count = static_cast<size_t>(last - first);
+		run_chunks("parallel_transform", 0, count, schedule, grain, OnError::finish, [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++) {
+				d_first[i] = op(first[i]);
+			}
+		});
+		return d_first + static_cast<std::ptrdiff_t>(count);
+	}
+
+	/// @brief Writes the inclusive prefix reductions of [first, last) under op to the range starting at d_first
+	/// @param first The start of the input range
+	/// @param last The end of the input range
+	/// @param d_first The start of the output range (may equal first)
+	/// @param op The associative reduction
+	/// @return The end of the output range
+	///
+	/// Two passes over the data: each block is reduced, the block totals are scanned on the calling thread, then
+	/// each block is scanned starting from the total of the blocks before it.
+	template <std::random_access_iterator It, std::random_access_iterator Out, typename BinaryOp = std::plus<>>
+	Out parallel_inclusive_scan(It first, It last, Out d_first, BinaryOp op = {}) {
+		using T = std::iter_value_t<It>;
+		return scan_blocks<T>(first, last, d_first, std::nullopt, op);
+	}
+
+	/// @brief Writes the exclusive prefix reductions of [first, last) under op, starting from init, to d_first
+	/// @param first The start of the input range
+	/// @param last The end of the input range
+	/// @param d_first The start of the output range (may equal first)
+	/// @param init The value written first, and combined before every element
+	/// @param op The associative reduction
+	/// @return The end of the output range
+	///
+	/// As with parallel_reduce, the block totals start from an element converted to T.
+	template <std::random_access_iterator It, std::random_access_iterator Out, typename T,
+			  typename BinaryOp = std::plus<>>
+		requires std::constructible_from<T, std::iter_reference_t<It>>
+	Out parallel_exclusive_scan(It first, It last, Out d_first, T init, BinaryOp op = {}) {
+		return scan_blocks<T>(first, last, d_first, std::optional<T>(std::move(init)), op);
+	}
+
+	/// @brief Sorts [first, last) with comp (not stable)
+	/// @param first The start of the range
+	/// @param last The end of the range
+	/// @param comp The strict weak ordering to sort by
+	///
+	/// A merge sort: every participant sorts one block with std::sort, then neighbouring sorted runs are merged
+	/// pairwise until one run is left. Each merge round is split into one equal slice of the output per block,
+	/// found by binary search, so even the last round, a single merge, is shared by every participant. The rounds
+	/// move elements between the range and a buffer of the same size; element types that are not default
+	/// constructible are merged in place instead, merge by merge.
+	template <std::random_access_iterator It, typename Compare = std::less<>>
+	void parallel_sort(It first, It last, Compare comp = {}) {
+		using T = std::iter_value_t<It>;
+		size_t count = static_cast<size_t>(last - first);
+		size_t blocks = block_count(count / min_sort_block);
+		auto bound = [&](size_t block) { return count * block / blocks; };
+		if constexpr (std::is_default_constructible_v<T>) {
+			size_t rounds = 0;
+			for (size_t width = 1; width < blocks; width *= 2) {
+				rounds++;
+			}
+			std::unique_ptr<T[]> buffer = rounds == 0 ? nullptr : std::make_unique_for_overwrite<T[]>(count);
+			// Start wherever makes the last round write back to the range
+			bool in_buffer = rounds % 2 == 1;
+			run_blocks("parallel_sort", count, blocks, [&](size_t, size_t begin, size_t end) {
+				std::sort(first + static_cast<std::ptrdiff_t>(begin), first + static_cast<std::ptrdiff_t>(end), comp);
+				if (in_buffer) {
+					std::move(first + static_cast<std::ptrdiff_t>(begin), first + static_cast<std::ptrdiff_t>(end),
+							  buffer.get() + begin);
+				}
+			});
+			for (size_t width = 1; width < blocks; width *= 2) {
+				if (in_buffer) {
+					merge_round(buffer.get(), first, blocks, width, bound, comp);
+				} else {
+					merge_round(first, buffer.get(), blocks, width, bound, comp);
+				}
+				in_buffer = !in_buffer;
+			}
+		} else {
+			auto at = [&](size_t block) { return first + static_cast<std::ptrdiff_t>(bound(block)); };
+			run_blocks("parallel_sort", count, blocks,
+					   [&](size_t block, size_t, size_t) { std::sort(at(block), at(block + 1), comp); });
+			for (size_t width = 1; width < blocks; width *= 2) {
+				size_t merges = (blocks + 2 * width - 1) / (2 * width);
+				run_chunks("parallel_sort", 0, merges, Schedule::dynamic, 1, OnError::finish, [&](size_t merge, size_t) {
+					size_t left = merge * 2 * width;
+					size_t middle = std::min(left + width, blocks);
+					size_t right = std::min(left + 2 * width, blocks);
+					std::inplace_merge(at(left), at(middle), at(right), comp);
+				});
+			}
+		}
+	}
+
+   private:
+	/// @brief Stand-in for the counters and timestamps of a pool without CollectStats
+	struct NoStats {};
+
+	/// @brief Counters of one worker, updated with relaxed atomics on cache lines of their own
+	struct alignas(cache_line_size) Counters {
+		std::atomic<uint64_t> tasks_started = 0;
+		std::atomic<uint64_t> tasks_executed = 0;
+		std::atomic<int64_t> busy_ns = 0;
+		std::atomic<int64_t> idle_ns = 0;
+		std::atomic<int64_t> lock_wait_ns = 0;
+		std::atomic<uint64_t> steal_attempts = 0;
+		std::atomic<uint64_t> steals = 0;
+		std::array<std::atomic<uint64_t>, WorkerStats::queue_wait_buckets> queue_wait{};
+
+		WorkerStats snapshot() const {
+			WorkerStats stats;
+			stats.tasks_started = tasks_started.load(std::memory_order_relaxed);
+			stats.tasks_executed = tasks_executed.load(std::memory_order_relaxed);
+			stats.busy_time = std::chrono::nanoseconds(busy_ns.load(std::memory_order_relaxed));
+			stats.idle_time = std::chrono::nanoseconds(idle_ns.load(std::memory_order_relaxed));
+			stats.lock_wait_time = std::chrono::nanoseconds(lock_wait_ns.load(std::memory_order_relaxed));
+			stats.steal_attempts = steal_attempts.load(std::memory_order_relaxed);
+			stats.steals = steals.load(std::memory_order_relaxed);
+			for (size_t i = 0; i < WorkerStats::queue_wait_buckets; i++) {
+				stats.queue_wait[i] = queue_wait[i].load(std::memory_order_relaxed);
+			}
+			return stats;
+		}
+	};
+
+	using MaybeCounters = std::conditional_t<CollectStats, Counters, NoStats>;
+
+	/// @brief steady_clock time in nanoseconds
+	static int64_t now_ns() noexcept {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+				   std::chrono::steady_clock::now().time_since_epoch())
+			.count();
+	}
+
+	struct Job {
+		Job(Task&& task, const char* label = nullptr) noexcept : task(std::move(task)), label(label) {
+			if constexpr (CollectStats) {
+				queued_at = now_ns();
+			}
+		}
+		/// Empty placeholder, only left behind by a bounded queue when making a job throws
+		Job() noexcept = default;
+		Task task;
+		/// Name in a trace, nullptr for a plain detached task
+		const char* label = nullptr;
+		[[no_unique_address]] std::conditional_t<CollectStats, int64_t, NoStats> queued_at{};
+	};
+
+	struct THREADPOOL_HOT_ALIGN Worker {
+		Worker(size_t index, size_t node, std::vector<unsigned> cpus)
+			: index(index),
+			  node(node),
+			  cpus(std::move(cpus)),
+			  victim_seed(static_cast<uint32_t>(index) * 2654435761u + 1) {}
+
+		/// @brief Locks the deque, adding the time spent blocked on it to counters (if any)
+		std::unique_lock<std::mutex> lock_jobs([[maybe_unused]] Counters* counters) {
+			if constexpr (CollectStats) {
+				std::unique_lock<std::mutex> lock(deque_lock, std::try_to_lock);
+				if (!lock) {
+					int64_t start = now_ns();
+					lock.lock();
+					if (counters) {
+						counters->lock_wait_ns.fetch_add(now_ns() - start, std::memory_order_relaxed);
+					}
+				}
+				return lock;
+			} else {
+				return std::unique_lock<std::mutex>(deque_lock);
+			}
+		}
+
+		/// @brief Pops the most recently pushed job (owner end)
+		std::optional<Job> pop(Counters* counters = nullptr) {
+			std::unique_lock<std::mutex> lock = lock_jobs(counters);
+			if (jobs.empty()) {
+				return std::nullopt;
+			}
+			Job job = std::move(jobs.back());
+			jobs.pop_back();
+			return job;
+		}
+
+		/// @brief Takes the oldest job (thief end)
+		std::optional<Job> steal(Counters* thief = nullptr) {
+			std::unique_lock<std::mutex> lock = lock_jobs(thief);
+			if (jobs.empty()) {
+				return std::nullopt;
+			}
+			Job job = std::move(jobs.front());
+			jobs.pop_front();
+			return job;
+		}
+
+		/// @brief Picks a pseudo-random worker to start stealing from (xorshift, owner only)
+		size_t next_victim(size_t num_workers) {
+			victim_seed ^= victim_seed << 13;
+			victim_seed ^= victim_seed >> 17;
+			victim_seed ^= victim_seed << 5;
+			return victim_seed % num_workers;
+		}
+
+		// The owner's line: read-mostly fields and the owner's own scratch state
+		const size_t index;
+		const size_t node;
+		/// CPUs the worker is pinned to, empty when not pinned
+		const std::vector<unsigned> cpus;
+		uint32_t victim_seed;
+		uint32_t picks = 0;
+		/// Set when the worker is to exit after its current job, cleared before its slot is reused
+		std::atomic<bool> retire = false;
+		/// Bumped (and notified) each time a thread running this worker exits
+		std::atomic<uint32_t> exits = 0;
+		/// Number of threads started for this worker, guarded by resize_lock
+		uint32_t starts = 0;
+		/// Where the worker records its tasks, nullptr while not tracing
+		std::atomic<TraceRing*> trace = nullptr;
+		/// The token of the worker's thread, stopped when the pool stops
+		std::stop_token stop;
+		// Written by thieves as well as the owner
+		THREADPOOL_HOT_ALIGN std::mutex deque_lock;
+		RingDeque<Job> jobs;
+		/// Jobs pinned to this worker with TaskOptions::worker, pushed by anyone, never stolen
+		LockedQueue<Job> inbox;
+		// Released by whichever thread wakes the worker
+		THREADPOOL_HOT_ALIGN std::binary_semaphore wakeup{0};
+		[[no_unique_address]] MaybeCounters counters;
+	};
+
+	/// @brief Shared error state of one blocking call
+	struct BatchStatus {
+		explicit BatchStatus(OnError on_error) : on_error(on_error) {}
+
+		/// @brief Run one piece of the batch, recording the first exception thrown by any piece
+		template <typename Func>
+		void run(Func&& func) noexcept {
+			if (on_error == OnError::cancel && failed.load(std::memory_order_relaxed)) {
+				return;
+			}
+			try {
+				func();
+			} catch (...) {
+				fail(std::current_exception());
+			}
+		}
+
+		/// @brief Record an error that no piece threw, unless another one came first
+		void fail(std::exception_ptr exception) noexcept {
+			if (!failed.exchange(true)) {
+				error = std::move(exception);
+			}
+		}
+
+		/// @brief Rethrow the first exception, once every piece of the batch has finished
+		void rethrow() const {
+			if (error) {
+				std::rethrow_exception(error);
+			}
+		}
+
+		const OnError on_error;
+		std::atomic<bool> failed = false;
+		std::exception_ptr error;
+	};
+
+	/// @brief Runs a graph node, then keeps going with the first successor that it made ready
+	void run_graph_nodes(TaskGraph& graph, BatchStatus& status, TaskGraph::NodeId id) {
+		for (;;) {
+			TaskGraph::Node& node = graph.nodes[id];
+			status.run([&] { node.work(); });
+			std::optional<TaskGraph::NodeId> next;
+			for (TaskGraph::NodeId successor : node.successors) {
+				if (graph.nodes[successor].pending.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+					continue;
+				}
+				if (!next) {
+					next = successor;
+				} else {
+					try {
+						push_jobs(
+							1, [&](size_t) { return GraphJob(*this, graph, status, successor); }, Priority::normal,
+							"run_graph");
+					} catch (...) {
+						// Shut down (or out of memory) since the graph started: the successor is dropped
+						skip_graph_nodes(graph, status, successor);
+					}
+				}
+			}
+			graph.remaining.done();
+			if (!next) {
+				return;
+			}
+			id = *next;
+		}
+	}
+
+	/// @brief Skips a graph node dropped at shutdown, and every node that only it could still have made ready
+	///
+	/// The graph's caller then gets std::future_errc::broken_promise instead of waiting for nodes that never run.
+	void skip_graph_nodes(TaskGraph& graph, BatchStatus& status, TaskGraph::NodeId id) noexcept {
+		status.fail(std::make_exception_ptr(std::future_error(std::future_errc::broken_promise)));
+		std::vector<TaskGraph::NodeId> skipped;
+		for (;;) {
+			for (TaskGraph::NodeId successor : graph.nodes[id].successors) {
+				if (graph.nodes[successor].pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+					try {
+						skipped.push_back(successor);
+					} catch (...) {
+						// Out of memory: skip it right away instead, through the stack
+						skip_graph_nodes(graph, status, successor);
+					}
+				}
+			}
+			// Not the last node to finish while skipped still holds some, so the graph outlives this loop
+			graph.remaining.done();
+			if (skipped.empty()) {
+				return;
+			}
+			id = skipped.back();
+			skipped.pop_back();
+		}
+	}
+
+	/// @brief Queued job running a graph node (see run_graph_nodes), which skips the node if it is dropped instead
+	class GraphJob {
+	   public:
+		GraphJob(BasicThreadPool& pool, TaskGraph& graph, BatchStatus& status, TaskGraph::NodeId id) noexcept
+			: pool(&pool), graph(&graph), status(&status), id(id) {}
+
+		GraphJob(GraphJob&& other) noexcept
+			: pool(other.pool), graph(std::exchange(other.graph, nullptr)), status(other.status), id(other.id) {}
+
+		GraphJob(const GraphJob&) = delete;
+		GraphJob& operator=(const GraphJob&) = delete;
+		GraphJob& operator=(GraphJob&&) = delete;
+
+		void operator()() {
+			pool->run_graph_nodes(*std::exchange(graph, nullptr), *status, id);
+		}
+
+		~GraphJob() {
+			if (graph) {
+				pool->dropped_helpers.fetch_add(1, std::memory_order_relaxed);
+				pool->skip_graph_nodes(*graph, *status, id);
+			}
+		}
+
+	   private:
+		BasicThreadPool* pool;
+		TaskGraph* graph;
+		BatchStatus* status;
+		TaskGraph::NodeId id;
+	};
+
+	/// @brief A value on a cache line of its own
+	template <typename T>
+	struct alignas(cache_line_size) Padded {
+		T value;
+	};
+
+	/// @brief Below this many elements per block, parallel_sort uses fewer blocks
+	static constexpr size_t min_sort_block = 2048;
+
+	/// @brief Number of blocks to split count items into: one per participant, at most one per item
+	size_t block_count(size_t count) const {
+		size_t threads = size() + (current_pool == this ? 0 : 1);
+		return std::clamp<size_t>(threads, 1, std::max<size_t>(count, 1));
+	}
+
+	/// @brief Number of elements among the first output elements of std::merge(a, a + a_size, b, b + b_size)
+	/// that come from a
+	template <typename It, typename Compare>
+	static size_t merge_split(It a, size_t a_size, It b, size_t b_size, size_t output, Compare& comp) {
+		size_t low = output > b_size ? output - b_size : 0;
+		size_t high = std::min(output, a_size);
+		while (low < high) {
+			// Too few from a while the next one from a does not come after the last one taken from b
+			size_t middle = low + (high - low) / 2;
+			if (!comp(b[static_cast<std::ptrdiff_t>(output - middle - 1)], a[static_cast<std::ptrdiff_t>(middle)])) {
+				low = middle + 1;
+			} else {
+				high = middle;
+			}
+		}
+		return low;
+	}
+
+	/// @brief Moves the runs of [0, blocks) blocks from source to destination, merging neighbouring runs of width
+	/// blocks each
+	///
+	/// Every block's worth of the output is a piece of its own: its ends are split between the two runs with
+	/// merge_split, then the piece is merged independently of the others.
+	template <typename Source, typename Destination, typename Bound, typename Compare>
+	void merge_round(Source source, Destination destination, size_t blocks, size_t width, Bound& bound,
+					 Compare& comp) {
+		run_chunks("parallel_sort", 0, blocks, Schedule::dynamic, 1, OnError::finish, [&](size_t piece, size_t) {
+			size_t left = piece / (2 * width) * 2 * width;
+			size_t begin = bound(left);
+			size_t middle = bound(std::min(left + width, blocks)) - begin;
+			size_t size = bound(std::min(left + 2 * width, blocks)) - begin;
+			Source a = source + static_cast<std::ptrdiff_t>(begin);
+			Source b = a + static_cast<std::ptrdiff_t>(middle);
+			size_t output_begin = bound(piece) - begin;
+			size_t output_end = bound(piece + 1) - begin;
+			size_t a_begin = merge_split(a, middle, b, size - middle, output_begin, comp);
+			size_t a_end = merge_split(a, middle, b, size - middle, output_end, comp);
+			auto from = [](Source it, size_t offset) {
+				return std::make_move_iterator(it + static_cast<std::ptrdiff_t>(offset));
+			};
+			std::merge(from(a, a_begin), from(a, a_end), from(b, output_begin - a_begin), from(b, output_end - a_end),
+					   destination + static_cast<std::ptrdiff_t>(begin + output_begin), comp);
+		});
+	}
+
+	/// @brief Splits [0, count) into blocks contiguous blocks and runs body(block, begin, end) for each
+	template <typename BlockBody>
+	void run_blocks(const char* label, size_t count, size_t blocks, BlockBody&& body) {
+		run_chunks(label, 0, blocks, Schedule::dynamic, 1, OnError::finish, [&](size_t block, size_t) {
+			size_t begin = count * block / blocks;
+			size_t end = count * (block + 1) / blocks;
+			if (begin < end) {
+				body(block, begin, end);
+			}
+		});
+	}
+
+	/// @brief Inclusive scan, or exclusive scan when init is set
+	template <typename T, typename It, typename Out, typename BinaryOp>
+	Out scan_blocks(It first, It last, Out d_first, std::optional<T> init, BinaryOp& op) {
+		size_t count = static_cast<size_t>(last - first);
+		size_t blocks = block_count(count);
+		bool exclusive = init.has_value();
+		// Pass 1: the total of every block but the last, stored with the block after it
+		std::vector<Padded<std::optional<T>>> carry(blocks);
+		run_blocks("parallel_scan", count, blocks, [&](size_t block, size_t begin, size_t end) {
+			if (block + 1 == blocks) {
+				return;
+			}
+			T total = static_cast<T>(first[begin]);
+			for (size_t i = begin + 1; i < end; i++) {
+				total = op(std::move(total), first[i]);
+			}
+			carry[block + 1].value = std::move(total);
+		});
+		// Turn the totals into the prefix before each block
+		std::optional<T> prefix = std::move(init);
+		for (auto& block_carry : carry) {
+			if (block_carry.value) {
+				prefix = prefix ? op(std::move(*prefix), std::move(*block_carry.value)) : std::move(*block_carry.value);
+			}
+			block_carry.value = prefix;
+		}
+		// Pass 2: scan every block from its prefix, reading each element before writing its output
+		run_blocks("parallel_scan", count, blocks, [&](size_t block, size_t begin, size_t end) {
+			std::optional<T> running = std::move(carry[block].value);
+			for (size_t i = begin; i < end; i++) {
+				T value = static_cast<T>(first[i]);
+				if (exclusive) {
+					d_first[i] = *running;
+					running = op(std::move(*running), std::move(value));
+				} else {
+					running = running ? op(std::move(*running), std::move(value)) : std::move(value);
+					d_first[i] = *running;
+				}
+			}
+		});
+		return d_first + static_cast<std::ptrdiff_t>(count);
+	}
+
+	/// @brief Shared state of one run_loop call, handing out chunks of [start, end)
+	struct LoopRange {
+		LoopRange(size_t start, size_t end, Schedule schedule, size_t grain, size_t participants)
+			: start(start),
+			  end(end),
+			  schedule(schedule),
+			  grain(grain),
+			  participants(participants),
+			  next(schedule == Schedule::static_blocks ? 0 : start) {}
+
+		/// @brief Claims the next chunk
+		/// @return false once the whole range has been handed out
+		bool claim(size_t& chunk_begin, size_t& chunk_end) {
+			if (schedule == Schedule::static_blocks) {
+				size_t block = next.fetch_add(1, std::memory_order_relaxed);
+				if (block >= participants) {
+					return false;
+				}
+				// One block per participant, with the remainder spread over the first blocks
+				size_t quotient = (end - start) / participants;
+				size_t remainder = (end - start) % participants;
+				chunk_begin = start + block * quotient + std::min(block, remainder);
+				chunk_end = chunk_begin + quotient + (block < remainder ? 1 : 0);
+				return true;
+			}
+			if (schedule == Schedule::dynamic) {
+				chunk_begin = next.fetch_add(grain, std::memory_order_relaxed);
+				if (chunk_begin >= end) {
+					return false;
+				}
+				chunk_end = chunk_begin + std::min(grain, end - chunk_begin);
+				return true;
+			}
+			chunk_begin = next.load(std::memory_order_relaxed);
+			do {
+				if (chunk_begin >= end) {
+					return false;
+				}
+				size_t remaining = end - chunk_begin;
+				chunk_end = chunk_begin + std::min(remaining, std::max(grain, remaining / (2 * participants)));
+			} while (!next.compare_exchange_weak(chunk_begin, chunk_end, std::memory_order_relaxed));
+			return true;
+		}
+
+		const size_t start;
+		const size_t end;
+		const Schedule schedule;
+		const size_t grain;
+		const size_t participants;
+		/// Next block index for the static schedule, next loop index otherwise
+		std::atomic<size_t> next;
+	};
+
+	/// @brief Shared state of one run_loop call with Schedule::adaptive
+	///
+	/// Each participant starts with an equal block of the range and takes chunks off its front. A participant
+	/// whose block is used up steals the back half of the largest block left, or the whole block of a
+	/// participant that has not started yet, so the range is only split further while someone is out of work
+	/// (lazy binary splitting) and the caller can still finish it alone.
+	///
+	/// A chunk is sized from the cost per index measured on the previous chunk so that it lasts about
+	/// adaptive_chunk_ns, growing at most fourfold per chunk. The first chunk starts from the cost remembered
+	/// for the loop body type, if any, and from grain otherwise.
+	struct AdaptiveRange {
+		AdaptiveRange(size_t start, size_t end, size_t grain, size_t participants, uint64_t remembered_ps)
+			: grain(grain),
+			  participants(participants),
+			  heap_blocks(participants > inline_blocks.size() ? new Block[participants] : nullptr),
+			  blocks(heap_blocks ? heap_blocks.get() : inline_blocks.data()),
+			  cost_ps(remembered_ps) {
+			size_t quotient = (end - start) / participants;
+			size_t remainder = (end - start) % participants;
+			for (size_t i = 0; i < participants; i++) {
+				size_t begin = start + i * quotient + std::min(i, remainder);
+				blocks[i].begin.store(begin, std::memory_order_relaxed);
+				blocks[i].end.store(begin + quotient + (i < remainder ? 1 : 0), std::memory_order_relaxed);
+			}
+			// A remembered cost only seeds a part of each block, in case this call's indices are costlier
+			first_chunk_limit = std::max(grain, quotient / 8);
+		}
+
+		/// @brief Runs run_chunk(begin, end) over chunks until no block is left to take from
+		template <typename RunChunk>
+		void participate(RunChunk&& run_chunk) {
+			size_t self = next_participant.fetch_add(1, std::memory_order_relaxed);
+			Block& own = blocks[self];
+			uint64_t seed = cost_ps.load(std::memory_order_relaxed);
+			size_t chunk = seed == 0 ? grain : std::clamp<size_t>(chunk_for(seed), grain, first_chunk_limit);
+			uint64_t measured = 0;
+			do {
+				size_t chunk_begin;
+				size_t chunk_end;
+				while (take(own, chunk, chunk_begin, chunk_end)) {
+					int64_t chunk_start = now_ns();
+					run_chunk(chunk_begin, chunk_end);
+					int64_t elapsed = std::max<int64_t>(now_ns() - chunk_start, 1);
+					measured = static_cast<uint64_t>(elapsed) * 1000 / (chunk_end - chunk_begin);
+					chunk = std::clamp<size_t>(chunk_for(measured), grain, std::max(grain, chunk * 4));
+				}
+			} while (steal(self));
+			if (measured != 0) {
+				cost_ps.store(measured, std::memory_order_relaxed);
+			}
+		}
+
+		/// @brief The last cost per index measured by a participant, in picoseconds (0 if none was)
+		uint64_t cost() const {
+			return cost_ps.load(std::memory_order_relaxed);
+		}
+
+	   private:
+		struct alignas(cache_line_size) Block {
+			std::mutex lock;
+			/// Written under lock, read without it to pick a victim
+			std::atomic<size_t> begin = 0;
+			std::atomic<size_t> end = 0;
+		};
+
+		/// @brief Indices per chunk for a chunk to last about adaptive_chunk_ns
+		static size_t chunk_for(uint64_t cost_ps) {
+			return static_cast<size_t>(static_cast<uint64_t>(adaptive_chunk_ns) * 1000 / std::max<uint64_t>(cost_ps, 1));
+		}
+
+		/// @brief Takes up to chunk indices off the front of the participant's own block
+		static bool take(Block& own, size_t chunk, size_t& chunk_begin, size_t& chunk_end) {
+			std::scoped_lock<std::mutex> lock(own.lock);
+			chunk_begin = own.begin.load(std::memory_order_relaxed);
+			size_t end = own.end.load(std::memory_order_relaxed);
+			if (chunk_begin >= end) {
+				return false;
+			}
+			chunk_end = chunk_begin + std::min(chunk, end - chunk_begin);
+			own.begin.store(chunk_end, std::memory_order_relaxed);
+			return true;
+		}
+
+		/// @brief Refills the participant's own (empty) block from the largest block it may split
+		/// @return false once every block is empty, started and too small to split
+		bool steal(size_t self) {
+			for (;;) {
+				size_t started = next_participant.load(std::memory_order_relaxed);
+				size_t victim = participants;
+				size_t most = 0;
+				for (size_t i = 0; i < participants; i++) {
+					size_t begin = blocks[i].begin.load(std::memory_order_relaxed);
+					size_t end = blocks[i].end.load(std::memory_order_relaxed);
+					size_t left = end > begin ? end - begin : 0;
+					if (i != self && left > most && (i >= started || left >= 2 * grain)) {
+						victim = i;
+						most = left;
+					}
+				}
+				if (victim == participants) {
+					return false;
+				}
+				Block& from = blocks[victim];
+				size_t stolen_begin;
+				size_t stolen_end;
+				{
+					std::scoped_lock<std::mutex> lock(from.lock);
+					size_t begin = from.begin.load(std::memory_order_relaxed);
+					stolen_end = from.end.load(std::memory_order_relaxed);
+					size_t left = stolen_end > begin ? stolen_end - begin : 0;
+					bool unstarted = victim >= next_participant.load(std::memory_order_relaxed);
+					if (left == 0 || (!unstarted && left < 2 * grain)) {
+						continue;
+					}
+					// A block whose owner has not started yet is taken whole, any other one is split in half
+					stolen_begin = unstarted ? begin : begin + left / 2;
+					from.end.store(stolen_begin, std::memory_order_relaxed);
+				}
+				Block& own = blocks[self];
+				std::scoped_lock<std::mutex> lock(own.lock);
+				own.begin.store(stolen_begin, std::memory_order_relaxed);
+				own.end.store(stolen_end, std::memory_order_relaxed);
+				return true;
+			}
+		}
+
+		const size_t grain;
+		const size_t participants;
+		size_t first_chunk_limit;
+		std::array<Block, 16> inline_blocks;
+		std::unique_ptr<Block[]> heap_blocks;  // only for more than 16 participants
+		Block* const blocks;
+		std::atomic<size_t> next_participant = 0;
+		std::atomic<uint64_t> cost_ps;
+	};
+
+	/// @brief Target duration of an adaptive chunk
+	///
+	/// Claiming and timing a chunk costs a few tens of nanoseconds, under 1% of a chunk this long, while the
+	/// participants of a loop still finish within about one chunk of each other.
+	static constexpr int64_t adaptive_chunk_ns = 10'000;
+
+	/// @brief The cost per index, in picoseconds, last measured by an adaptive loop with this chunk body
+	///
+	/// The cost is keyed by the type of the body, not by the call site: each lambda has a type of its own, but
+	/// every loop whose body is, say, a std::function or a function pointer of the same signature shares one
+	/// entry, and the last loop to finish overwrites what the others measured.
+	template <typename ChunkBody>
+	static inline std::atomic<uint64_t> adaptive_cost = 0;
+
+	/// @brief Runs chunk_body over chunks of [start, end) on the pool and waits for them to finish
+	///
+	/// The calling thread claims chunks alongside at most one helper job per worker; each participant keeps
+	/// claiming until the range is exhausted. The caller then only waits for the helpers already claiming, while
+	/// those still queued do nothing once dequeued. Since the caller can finish the whole range on its own, the
+	/// call never depends on a free worker, which makes nested blocking calls safe.
+	template <typename ChunkBody>
+	void run_chunks(const char* label, size_t start, size_t end, Schedule schedule, size_t grain, OnError on_error,
+					ChunkBody&& chunk_body) {
+		if (start >= end) {
+			return;
+		}
+		TracedCall traced(*this, label);
+		size_t count = end - start;
+		grain = std::max<size_t>(grain, 1);
+		size_t chunks = schedule == Schedule::static_blocks ? count : (count + grain - 1) / grain;
+		// A worker calling in already occupies its own slot, any other thread joins in as an extra participant
+		size_t threads = size() + (current_pool == this ? 0 : 1);
+		size_t participants = std::max<size_t>(std::min(threads, chunks), 1);
+		if (schedule == Schedule::adaptive) {
+			std::atomic<uint64_t>& remembered = adaptive_cost<std::decay_t<ChunkBody>>;
+			AdaptiveRange range(start, end, grain, participants, remembered.load(std::memory_order_relaxed));
+			run_participants(label, participants, on_error, chunk_body,
+							 [&](auto&& run_chunk) { range.participate(run_chunk); });
+			if (range.cost() != 0) {
+				remembered.store(range.cost(), std::memory_order_relaxed);
+			}
+			return;
+		}
+		LoopRange range(start, end, schedule, grain, participants);
+		run_participants(label, participants, on_error, chunk_body, [&](auto&& run_chunk) {
+			size_t chunk_begin;
+			size_t chunk_end;
+			while (range.claim(chunk_begin, chunk_end)) {
+				run_chunk(chunk_begin, chunk_end);
+			}
+		});
+	}
+
+	/// @brief Runs claim_chunks on the calling thread and on participants - 1 helper jobs, and waits for them
+	///
+	/// claim_chunks(run_chunk) calls run_chunk(begin, end) for every chunk it claims, which runs chunk_body
+	/// on it and records its exception.
+	template <typename ChunkBody, typename ClaimChunks>
+	void run_participants(const char* label, size_t participants, OnError on_error, ChunkBody& chunk_body,
+						  ClaimChunks&& claim_chunks) {
+		BatchStatus status(on_error);
+		auto participate = [&] {
+			claim_chunks([&](size_t chunk_begin, size_t chunk_end) {
+				status.run([&] { chunk_body(chunk_begin, chunk_end); });
+			});
+		};
+		if (participants == 1) {
+			check_running();
+			participate();
+			status.rethrow();
+			return;
+		}
+		auto call = std::make_shared<Participation>(
+			[](void* context) { (*static_cast<decltype(participate)*>(context))(); }, &participate);
+		try {
+			// A helper dropped at shutdown or dequeued after the caller returned has nothing left to claim
+			push_jobs(
+				participants - 1, [&](size_t) { return HelperJob(*this, call); }, Priority::normal, label);
+		} catch (...) {
+			call->finish();
+			wait_helping(call->inside);
+			throw;
+		}
+		participate();
+		call->finish();
+		wait_helping(call->inside);
+		status.rethrow();
+	}
+
+	/// @brief What a blocking call shares with its helper jobs, which may still be queued once it has returned
+	///
+	/// inside counts the caller, until it has claimed its last chunk, and the helpers claiming alongside it. After
+	/// it reaches zero the caller's state is gone, and a helper dequeued later must not join.
+	struct Participation {
+		Participation(void (*participate)(void*), void* context) noexcept
+			: participate(participate), context(context) {}
+
+		/// @brief Joins the call unless the caller has already finished with it
+		bool enter() noexcept {
+			uint32_t count = inside.count.load(std::memory_order_relaxed);
+			do {
+				if (count == 0) {
+					return false;
+				}
+			} while (!inside.count.compare_exchange_weak(count, count + 1, std::memory_order_acquire,
+														  std::memory_order_relaxed));
+			return true;
+		}
+
+		/// @brief The caller's own share is done: only the helpers already inside are waited for
+		void finish() noexcept {
+			inside.done();
+		}
+
+		WaitGroup inside{1};
+		void (*const participate)(void*);
+		void* const context;
+	};
+
+	/// @brief A blocking call's helper job; one dropped at shutdown is not counted among the tasks shutdown reports
+	/// as dropped
+	class HelperJob {
+	   public:
+		HelperJob(BasicThreadPool& pool, std::shared_ptr<Participation> call) noexcept
+			: pool(&pool), call(std::move(call)) {}
+
+		HelperJob(HelperJob&& other) noexcept : pool(other.pool), call(std::move(other.call)), ran(other.ran) {}
+
+		HelperJob(const HelperJob&) = delete;
+		HelperJob& operator=(const HelperJob&) = delete;
+		HelperJob& operator=(HelperJob&&) = delete;
+
+		void operator()() {
+			ran = true;
+			if (call->enter()) {
+				call->participate(call->context);
+				call->inside.done();
+			}
+		}
+
+		~HelperJob() {
+			if (call && !ran) {
+				pool->dropped_helpers.fetch_add(1, std::memory_order_relaxed);
+			}
+		}
+
+	   private:
+		BasicThreadPool* pool;
+		std::shared_ptr<Participation> call;
+		bool ran = false;
+	};
+
+	/// @brief Waits until a group's work is done
+	///
+	/// On a worker of this pool, queued jobs are run while waiting so that a nested blocking call cannot leave
+	/// its helpers stuck behind workers that are all waiting themselves.
+	void wait_helping(const WaitGroup& group) {
+		const std::atomic<uint32_t>& pending = group.count;
+		Worker* self = current_pool == this ? current_worker : nullptr;
+		for (uint32_t count; (count = pending.load(std::memory_order_acquire)) != 0;) {
+			if (self) {
+				if (std::optional<Job> job = next_job(*self)) {
+					run(*job);
+					continue;
+				}
+			}
+			// Nothing left to run: the outstanding helpers are already running on other workers
+			pending.wait(count, std::memory_order_acquire);
+		}
+	}
+
+	/// @brief The worker of this pool running on the calling thread, if any and if it owns a deque
+	Worker* local_worker() const {
+		if (mode == SchedulingMode::work_stealing && current_pool == this) {
+			return current_worker;
+		}
+		return nullptr;
+	}
+
+	/// @brief Pushes the jobs made by make_job(i) for i in [0, count) and wakes workers for them
+	///
+	/// From a worker in work stealing mode the jobs go to its own deque, otherwise to the global queue. Either
+	/// way the deque or a locked queue is locked once for the whole batch. When a bounded queue is full, the
+	/// rest of the batch waits for room. A batch submitted from outside a work stealing pool is split across the
+	/// workers' deques instead, one slice and one lock per worker. make_job is called once per index, in order.
+	template <typename MakeJob>
+	void push_jobs(size_t count, MakeJob&& make_job, Priority priority = Priority::normal,
+				   const char* label = nullptr) {
+		check_running();
+		if (count == 0) {
+			return;
+		}
+		// Counted before they become visible, so a job can never finish before it was counted
+		outstanding.fetch_add(count);
+		size_t made = 0;
+		auto make_counted = [&](size_t i) {
+			Job job(make_job(i), label);
+			made++;
+			return job;
+		};
+		try {
+			Worker* worker = priority == Priority::normal ? local_worker() : nullptr;
+			if (worker) {
+				push_to_deque(*worker, 0, count, make_counted);
+				wake_workers(count);
+				grow_if_backed_up();
+				return;
+			}
+			size_t active = num_workers.load(std::memory_order_acquire);
+			if (priority == Priority::normal && mode == SchedulingMode::work_stealing && current_pool != this &&
+				count > 1 && active > 1) {
+				size_t slices = std::min(active, count);
+				size_t first = next_slice_worker.fetch_add(1, std::memory_order_relaxed);
+				for (size_t slice = 0; slice < slices; slice++) {
+					push_to_deque(*workers[(first + slice) % active], count * slice / slices,
+								  count * (slice + 1) / slices, make_counted);
+				}
+				wake_workers(count);
+				grow_if_backed_up();
+				return;
+			}
+			size_t pushed = 0;
+			for (;;) {
+				size_t offset = pushed;
+				pushed += push_to_lane(priority, count - offset, [&](size_t i) { return make_counted(offset + i); });
+				wake_workers(pushed - offset);
+				if (pushed == count) {
+					grow_if_backed_up();
+					return;
+				}
+				wait_for_room();
+			}
+		} catch (...) {
+			// The jobs made before the exception are queued and run as usual
+			wake_workers(made);
+			finish_jobs(count - made);
+			throw;
+		}
+	}
+
+	/// @brief Pushes the jobs make_counted(i) for i in [begin, end) onto a worker's deque under one lock
+	template <typename MakeCounted>
+	void push_to_deque(Worker& worker, size_t begin, size_t end, MakeCounted& make_counted) {
+		size_t pushed = 0;
+		try {
+			std::unique_lock<std::mutex> lock = worker.lock_jobs(counters_of(local_worker()));
+			worker.jobs.reserve(end - begin);
+			for (size_t i = begin; i < end; i++) {
+				worker.jobs.emplace_back(make_counted(i));
+				pushed++;
+			}
+		} catch (...) {
+			local_jobs.fetch_add(pushed);
+			throw;
+		}
+		local_jobs.fetch_add(pushed);
+	}
+
+	/// @brief Marks jobs finished (run or dropped), waking wait_idle callers once nothing is outstanding
+	void finish_jobs(size_t count) {
+		if (count != 0 && outstanding.fetch_sub(count) == count && idle_waiters.load() != 0) {
+			// Taking the lock orders this with a waiter between checking the count and blocking
+			{ std::scoped_lock<std::mutex> lock(idle_lock); }
+			idle_changed.notify_all();
+		}
+	}
+
+	/// @brief Calls done() on a WaitGroup when destroyed, unless moved from
+	class GroupDone {
+	   public:
+		explicit GroupDone(WaitGroup* group) noexcept : group(group) {}
+
+		GroupDone(GroupDone&& other) noexcept : group(std::exchange(other.group, nullptr)) {}
+
+		GroupDone(const GroupDone&) = delete;
+		GroupDone& operator=(const GroupDone&) = delete;
+		GroupDone& operator=(GroupDone&&) = delete;
+
+		~GroupDone() {
+			if (group) {
+				group->done();
+			}
+		}
+
+	   private:
+		WaitGroup* group;
+	};
+
+	/// @brief The job resuming a coroutine that awaits schedule(); destroyed without running, it sets the
+	/// awaiter's dropped flag and resumes the coroutine anyway
+	class Resumption {
+	   public:
+		Resumption(std::coroutine_handle<> handle, bool& dropped) noexcept : handle(handle), dropped(&dropped) {}
+
+		Resumption(Resumption&& other) noexcept : handle(std::exchange(other.handle, {})), dropped(other.dropped) {}
+
+		Resumption(const Resumption&) = delete;
+		Resumption& operator=(const Resumption&) = delete;
+		Resumption& operator=(Resumption&&) = delete;
+
+		void operator()() {
+			std::exchange(handle, {}).resume();
+		}
+
+		~Resumption() {
+			if (handle) {
+				*dropped = true;
+				if (queueing != dropped) {
+					handle.resume();
+				}
+			}
+		}
+
+		/// @brief The dropped flag of the awaiter whose await_suspend is queueing a job on this thread
+		static inline thread_local const bool* queueing = nullptr;
+
+	   private:
+		std::coroutine_handle<> handle;
+		bool* dropped;
+	};
+
+	/// @brief Queues one task, adding it to options.group if there is one
+	template <typename Func>
+	void queue_grouped(Func&& task, const TaskOptions& options) {
+		if (WaitGroup* group = options.group) {
+			group->add();
+			// The group is marked done when the task is destroyed: after it ran, or if it is dropped unrun
+			queue_task([task = std::forward<Func>(task), done = GroupDone(group)]() mutable { task(); }, options);
+			return;
+		}
+		queue_task(std::forward<Func>(task), options);
+	}
+
+	/// @brief Binds func to args as an R() call, passing func a std::stop_token first if it takes one (see
+	/// call_with_stop)
+	template <typename R, typename Func, typename... Args>
+	static auto bind_call(std::stop_token stop_token, Func&& func, Args&&... args) {
+		if constexpr (std::is_invocable_v<std::decay_t<Func>, std::stop_token, std::decay_t<Args>...>) {
+			return [func = std::forward<Func>(func), ... args = std::forward<Args>(args),
+					stop_token = std::move(stop_token)]() mutable -> R {
+				return call_with_stop(
+					[&](std::stop_token token) -> R {
+						return std::invoke(std::move(func), std::move(token), std::move(args)...);
+					},
+					stop_token);
+			};
+		} else {
+			return [func = std::forward<Func>(func), ... args = std::forward<Args>(args)]() mutable -> R {
+				return std::invoke(std::move(func), std::move(args)...);
+			};
+		}
+	}
+
+	/// @brief Stores call and its result in one allocation and passes the task that runs it to queue
+	template <typename R, typename Call, typename Queue>
+	static TaskFuture<R> submit_call(Call&& call, Queue&& queue) {
+		using State = CallState<R, std::decay_t<Call>>;
+		auto* state = new State(std::move(call));
+		TaskFuture<R> future(state);
+		queue(FutureTask<State>(state));
+		return future;
+	}
+
+	/// @brief Stores a task, passing it the running worker's stop token if it takes one
+	template <typename Func>
+	static Task make_task(Func&& task) {
+		if constexpr (takes_stop_token<Func>) {
+			return Task(stoppable(std::forward<Func>(task), {}));
+		} else {
+			return Task(std::forward<Func>(task));
+		}
+	}
+
+	/// @brief Wraps a task into a void() callable that is skipped once stop_token is stopped and that passes the
+	/// task a std::stop_token if it takes one
+	template <typename Func>
+	static auto stoppable(Func&& task, std::stop_token stop_token) {
+		return [task = std::decay_t<Func>(std::forward<Func>(task)), stop_token = std::move(stop_token)]() mutable {
+			if (stop_token.stop_requested()) {
+				return;
+			}
+			if constexpr (takes_stop_token<Func>) {
+				call_with_stop(task, stop_token);
+			} else {
+				task();
+			}
+		};
+	}
+
+	/// @brief Calls body(token) with a token that is stopped once the pool stops or task_token is stopped
+	///
+	/// Only a worker's thread has a pool token. Following both tokens costs a std::stop_source, so it is only
+	/// made when the task has a token of its own.
+	template <typename Body>
+	static decltype(auto) call_with_stop(Body&& body, const std::stop_token& task_token) {
+		std::stop_token pool_token = current_worker ? current_worker->stop : std::stop_token();
+		if (!task_token.stop_possible()) {
+			return body(std::move(pool_token));
+		}
+		if (!pool_token.stop_possible()) {
+			return body(task_token);
+		}
+		std::stop_source either;
+		std::stop_callback on_task(task_token, [&] { either.request_stop(); });
+		std::stop_callback on_pool(pool_token, [&] { either.request_stop(); });
+		return body(either.get_token());
+	}
+
+	/// @brief Queues one task in the queue its options ask for (options.group is handled by queue_grouped)
+	template <typename Func>
+	void queue_task(Func&& task, const TaskOptions& options) {
+		check_running();
+		size_t active = num_workers.load(std::memory_order_acquire);
+		if (options.worker && active > 0) {
+			Worker& target = *workers[*options.worker % active];
+			outstanding.fetch_add(1);
+			try {
+				target.inbox.try_emplace([&] { return Job(Task(std::forward<Func>(task)), options.label); });
+			} catch (...) {
+				finish_jobs(1);
+				throw;
+			}
+			wake_pinned(target);
+			return;
+		}
+		if (options.priority == Priority::normal && options.numa_node && !node_queues.empty()) {
+			size_t node = *options.numa_node % node_queues.size();
+			outstanding.fetch_add(1);
+			try {
+				node_queues[node].try_emplace([&] { return Job(Task(std::forward<Func>(task)), options.label); });
+			} catch (...) {
+				finish_jobs(1);
+				throw;
+			}
+			wake_workers(1, node);
+			grow_if_backed_up();
+			return;
+		}
+		push_jobs(1, [&](size_t) { return Task(std::forward<Func>(task)); }, options.priority, options.label);
+	}
+
+	/// @brief A timer delay in nanoseconds, clamped to [0, 2^62] so that deadlines cannot overflow
+	template <typename Rep, typename Period>
+	static int64_t timer_ns(std::chrono::duration<Rep, Period> delay) {
+		constexpr double longest = static_cast<double>(int64_t{1} << 62);
+		double ns = std::chrono::duration<double, std::nano>(delay).count();
+		return ns <= 0 ? 0 : ns >= longest ? int64_t{1} << 62 : static_cast<int64_t>(ns);
+	}
+
+	ScheduledTask add_timer(int64_t delay_ns, int64_t period_ns, Task&& task) {
+		check_running();
+		TimerQueue::Added added = timers->add(std::move(task), now_ns() + delay_ns, period_ns);
+		wake_for_timer(added.wake);
+		return ScheduledTask(timers, std::move(added.entry));
+	}
+
+	/// @brief Wakes whoever TimerQueue asked for, so that a timer due earlier than expected is not missed
+	void wake_for_timer(size_t worker) {
+		if (worker == TimerQueue::any_worker) {
+			wake_workers(1);
+		} else if (worker != TimerQueue::no_one) {
+			unpark(*workers[worker]);
+		}
+	}
+
+	/// @brief Fires the due timers if the next one may be due, called by workers between jobs
+	void poll_timers() {
+		int64_t due = timers->next_due_ns();
+		if (due != TimerQueue::never && due <= now_ns()) {
+			expire_timers();
+		}
+	}
+
+	/// @brief Advances the timer wheel and queues one job per due timer, in the high lane so a backlog of other
+	/// tasks does not delay it
+	void expire_timers() {
+		TimerQueue::Entry* fired = timers->expire(now_ns());
+		if (!fired) {
+			return;
+		}
+		size_t count = 0;
+		for (TimerQueue::Entry* entry = fired; entry; entry = entry->next_fired) {
+			count++;
+		}
+		try {
+			push_jobs(
+				count,
+				[&](size_t) {
+					std::shared_ptr<TimerQueue::Entry> entry = std::move(fired->self);
+					fired = fired->next_fired;
+					return Task([this, entry = std::move(entry)] {
+						if (timers->start(*entry)) {
+							entry->task();
+						}
+						wake_for_timer(timers->finish(entry));
+					});
+				},
+				Priority::high, "timer");
+		} catch (...) {
+			// Re-arm (or retire) the timers whose job could not be queued
+			while (fired) {
+				std::shared_ptr<TimerQueue::Entry> entry = std::move(fired->self);
+				fired = fired->next_fired;
+				wake_for_timer(timers->finish(entry));
+			}
+			// A shutdown closing the timers after they expired leaves nothing to report
+			if (running.load(std::memory_order_acquire)) {
+				throw;
+			}
+		}
+	}
+
+	/// @brief Creates worker i according to the pool's Affinity
+	std::unique_ptr<Worker> make_worker(size_t i) const {
+		const CpuTopology& topology = CpuTopology::system();
+		switch (affinity.placement) {
+			case Placement::pin_cpus: {
+				std::vector<unsigned> cpus = affinity.cpus;
+				if (cpus.empty()) {
+					for (const auto& node_cpus : topology.nodes) {
+						cpus.insert(cpus.end(), node_cpus.begin(), node_cpus.end());
+					}
+				}
+				unsigned cpu = cpus[i % cpus.size()];
+				return std::make_unique<Worker>(i, topology.node_of(cpu), std::vector<unsigned>{cpu});
+			}
+			case Placement::numa_nodes: {
+				size_t node = i % topology.nodes.size();
+				return std::make_unique<Worker>(i, node, topology.nodes[node]);
+			}
+			default:
+				return std::make_unique<Worker>(i, 0, std::vector<unsigned>{});
+		}
+	}
+
+	/// @brief Wakes min(count, parked workers) workers for count new jobs
+	///
+	/// Submitting costs a fence and a load unless a worker is actually parked. The fence pairs with the one in
+	/// park() so that either the submitter sees the parked worker or the worker sees the new job. Workers still
+	/// spinning pick up the rest, so a small batch never wakes the whole pool.
+	///
+	/// With a preferred node, parked workers of that node are woken first.
+	void wake_workers(size_t count, std::optional<size_t> preferred_node = std::nullopt) {
+		if (count == 0) {
+			return;
+		}
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (sleepers.load(std::memory_order_relaxed) == 0) {
+			return;
+		}
+		while (count > 0) {
+			// Pick the workers under one lock acquisition, post their semaphores after releasing it
+			std::array<Worker*, 32> picked;
+			size_t num_picked;
+			{
+				std::scoped_lock<std::mutex> lock(park_lock);
+				if (preferred_node) {
+					std::stable_partition(parked.begin(), parked.end(),
+										  [&](Worker* worker) { return worker->node != *preferred_node; });
+				}
+				num_picked = std::min({count, parked.size(), picked.size()});
+				std::copy(parked.end() - static_cast<std::ptrdiff_t>(num_picked), parked.end(), picked.begin());
+				parked.resize(parked.size() - num_picked);
+				sleepers.fetch_sub(num_picked, std::memory_order_relaxed);
+			}
+			for (size_t i = 0; i < num_picked; i++) {
+				picked[i]->wakeup.release();
+			}
+			if (num_picked < picked.size()) {
+				return;
+			}
+			count -= num_picked;
+		}
+	}
+
+	/// @brief Whether any queue looked non-empty
+	bool work_available() const {
+		if (local_jobs.load(std::memory_order_relaxed) > 0) {
+			return true;
+		}
+		if (std::any_of(lanes.begin(), lanes.end(), [](const auto& queue) { return !queue.empty(); }) ||
+			std::any_of(pool_lanes.begin(), pool_lanes.end(), [](const auto& queue) { return !queue.empty(); })) {
+			return true;
+		}
+		return std::any_of(node_queues.begin(), node_queues.end(), [](const auto& queue) { return !queue.empty(); });
+	}
+
+	/// @brief Polls for a job according to the idle policy, then parks until woken
+	/// @return The job found while spinning, if any (after parking, the caller looks again)
+	std::optional<Job> wait_for_job(Worker& self) {
+		for (unsigned i = 0; i < idle_policy.spin + idle_policy.yield && running.load(std::memory_order_relaxed);
+			 i++) {
+			if (i < idle_policy.spin) {
+				cpu_relax();
+			} else {
+				std::this_thread::yield();
+			}
+			if (std::optional<Job> job = next_job(self)) {
+				return job;
+			}
+		}
+		park(self);
+		return std::nullopt;
+	}
+
+	/// @brief Parks a worker until wake_workers picks it, unless work shows up while it announces itself
+	///
+	/// A worker that elastic sizing added retires once it has been parked for the keep-alive. Otherwise, if no
+	/// other worker is keeping the timers, the worker parks until the next timer is due and then fires it.
+	void park(Worker& self) {
+		{
+			std::scoped_lock<std::mutex> lock(park_lock);
+			parked.push_back(&self);
+			sleepers.fetch_add(1, std::memory_order_relaxed);
+		}
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (work_available() || !self.inbox.empty() || !running.load(std::memory_order_relaxed) ||
+			self.retire.load(std::memory_order_relaxed)) {
+			if (unpark_self(self)) {
+				return;
+			}
+			// A submitter already picked this worker: consume its wakeup below
+		} else if (elastic.max_threads != 0 && self.index >= base_size.load(std::memory_order_relaxed)) {
+			if (self.wakeup.try_acquire_for(elastic.keep_alive)) {
+				return;
+			}
+			if (unpark_self(self)) {
+				retire_if_surplus(self);
+				return;
+			}
+		} else if (std::optional<int64_t> due = timers->claim_keeper(self.index)) {
+			bool woken = self.wakeup.try_acquire_until(
+				std::chrono::steady_clock::time_point(std::chrono::nanoseconds(*due)));
+			timers->release_keeper(self.index);
+			if (woken) {
+				return;
+			}
+			expire_timers();
+			if (unpark_self(self)) {
+				return;
+			}
+		}
+		self.wakeup.acquire();
+	}
+
+	/// @brief Takes a worker back off the parked list
+	/// @return false if a submitter already picked it, so that its wakeup is still to be consumed
+	bool unpark_self(Worker& self) {
+		std::scoped_lock<std::mutex> lock(park_lock);
+		auto it = std::find(parked.begin(), parked.end(), &self);
+		if (it == parked.end()) {
+			return false;
+		}
+		parked.erase(it);
+		sleepers.fetch_sub(1, std::memory_order_relaxed);
+		return true;
+	}
+
+	/// @brief Wakes a parked worker, so that it notices it is to retire or sees a job pinned to it
+	void unpark(Worker& worker) {
+		{
+			std::scoped_lock<std::mutex> lock(park_lock);
+			auto it = std::find(parked.begin(), parked.end(), &worker);
+			if (it == parked.end()) {
+				return;
+			}
+			parked.erase(it);
+			sleepers.fetch_sub(1, std::memory_order_relaxed);
+		}
+		worker.wakeup.release();
+	}
+
+	/// @brief Lets the worker a job was just pinned to see it
+	///
+	/// A parked worker is woken. A worker that is retiring may already have handed off its pinned jobs, and the
+	/// inbox lock orders that hand-off before this push, so seeing retire unset means the worker will still run
+	/// the job (or its slot is reused by a new worker that will).
+	void wake_pinned(Worker& target) {
+		if (target.retire.load(std::memory_order_relaxed)) {
+			hand_off_pinned(target);
+			wake_workers(1);
+			return;
+		}
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (sleepers.load(std::memory_order_relaxed) != 0) {
+			unpark(target);
+		}
+	}
+
+	/// @brief Moves the jobs pinned to a retiring worker to the global queue, so that any worker runs them
+	void hand_off_pinned(Worker& worker) {
+		while (std::optional<Job> job = worker.inbox.try_pop()) {
+			requeue(std::move(*job));
+		}
+	}
+
+	/// @brief Retires an idle worker above the base size, if it is the highest numbered one (indices stay dense)
+	void retire_if_surplus(Worker& self) {
+		std::unique_lock<std::mutex> lock(resize_lock, std::try_to_lock);
+		if (lock && running.load(std::memory_order_relaxed) && self.index >= base_size.load(std::memory_order_relaxed) &&
+			self.index + 1 == num_workers.load(std::memory_order_relaxed)) {
+			self.retire.store(true, std::memory_order_relaxed);
+			num_workers.store(self.index, std::memory_order_release);
+		}
+	}
+
+	/// @brief Adds a worker when the queues have stayed backed up for grow_after and no worker is parked
+	void grow_if_backed_up() {
+		if (elastic.max_threads == 0) {
+			return;
+		}
+		size_t active = num_workers.load(std::memory_order_relaxed);
+		bool backed_up = sleepers.load(std::memory_order_relaxed) == 0 && active < elastic.max_threads &&
+						 outstanding.load(std::memory_order_relaxed) > active + elastic.queue_depth;
+		if (!backed_up) {
+			if (backed_up_since.load(std::memory_order_relaxed) != 0) {
+				backed_up_since.store(0, std::memory_order_relaxed);
+			}
+			return;
+		}
+		int64_t now = now_ns();
+		int64_t since = backed_up_since.load(std::memory_order_relaxed);
+		if (since == 0) {
+			backed_up_since.compare_exchange_strong(since, now, std::memory_order_relaxed);
+			return;
+		}
+		if (now - since < std::chrono::duration_cast<std::chrono::nanoseconds>(elastic.grow_after).count()) {
+			return;
+		}
+		std::unique_lock<std::mutex> lock(resize_lock, std::try_to_lock);
+		active = num_workers.load(std::memory_order_relaxed);
+		if (lock && running.load(std::memory_order_relaxed) && active < elastic.max_threads) {
+			start_worker(active);
+			backed_up_since.store(0, std::memory_order_relaxed);
+		}
+	}
+
+	/// @brief Starts (or restarts) the thread of worker i, which must be num_workers (resize_lock held)
+	void start_worker(size_t i) {
+		if (i < threads.size() && threads[i].joinable()) {
+			// A retired worker whose thread has not been joined yet
+			threads[i].join();
+		}
+		if (!workers[i]) {
+			workers[i] = make_worker(i);
+			num_slots.store(i + 1, std::memory_order_release);
+		}
+		workers[i]->retire.store(false, std::memory_order_relaxed);
+		workers[i]->starts++;
+		if (threads.size() <= i) {
+			threads.resize(i + 1);
+		}
+		if (tracing.load(std::memory_order_relaxed)) {
+			std::scoped_lock<std::mutex> lock(trace_lock);
+			attach_trace(i);
+		}
+		num_workers.store(i + 1, std::memory_order_release);
+		threads[i] = std::jthread([this, i](std::stop_token stop) { worker_loop(i, std::move(stop)); });
+	}
+
+	/// @brief Backs off while a bounded global queue is full, helping to drain it when called from a worker
+	void wait_for_room() {
+		if (current_pool == this) {
+			if (std::optional<Job> job = next_job(*current_worker)) {
+				run(*job);
+				return;
+			}
+		}
+		std::this_thread::yield();
+	}
+
+	/// @brief Finds the next job for a worker
+	///
+	/// Looks at the high lane, the jobs pinned to it, its own deque, its node's queue, the normal lane, the deques
+	/// of workers on the same node, the other deques, the other nodes' queues and finally the background lane.
+	/// Every lane_aging_interval calls it looks at the background and normal lanes first instead.
+	std::optional<Job> next_job(Worker& self) {
+		if (++self.picks % lane_aging_interval == 0) {
+			for (Priority priority : {Priority::background, Priority::normal}) {
+				if (std::optional<Job> job = pop_lane(priority)) {
+					return job;
+				}
+			}
+		}
+		if (std::optional<Job> job = pop_lane(Priority::high)) {
+			return job;
+		}
+		if (std::optional<Job> job = self.inbox.try_pop()) {
+			return job;
+		}
+		if (local_jobs.load(std::memory_order_relaxed) > 0) {
+			if (std::optional<Job> job = self.pop(counters_of(&self))) {
+				local_jobs.fetch_sub(1, std::memory_order_relaxed);
+				return job;
+			}
+		}
+		if (!node_queues.empty()) {
+			if (std::optional<Job> job = node_queues[self.node].try_pop()) {
+				return job;
+			}
+		}
+		if (std::optional<Job> job = pop_lane(Priority::normal)) {
+			return job;
+		}
+		if (local_jobs.load(std::memory_order_relaxed) > 0) {
+			size_t count = num_slots.load(std::memory_order_acquire);
+			size_t start = self.next_victim(count);
+			for (int pass = node_queues.empty() ? 1 : 0; pass < 2; pass++) {
+				// Pass 0 only visits workers on the same node, pass 1 the rest
+				for (size_t i = 0; i < count; i++) {
+					Worker& victim = *workers[(start + i) % count];
+					bool same_node = victim.node == self.node;
+					if (&victim == &self || (!node_queues.empty() && same_node != (pass == 0))) {
+						continue;
+					}
+					if constexpr (CollectStats) {
+						self.counters.steal_attempts.fetch_add(1, std::memory_order_relaxed);
+					}
+					if (std::optional<Job> job = victim.steal(counters_of(&self))) {
+						if constexpr (CollectStats) {
+							self.counters.steals.fetch_add(1, std::memory_order_relaxed);
+						}
+						local_jobs.fetch_sub(1, std::memory_order_relaxed);
+						return job;
+					}
+				}
+			}
+		}
+		for (size_t node = 0; node < node_queues.size(); node++) {
+			if (node != self.node) {
+				if (std::optional<Job> job = node_queues[node].try_pop()) {
+					return job;
+				}
+			}
+		}
+		return pop_lane(Priority::background);
+	}
+
+	/// @brief Runs a job, skipping the empty placeholder a bounded queue leaves when making a job throws
+	///
+	/// The task is destroyed right after it ran, so whatever it captured is released before wait_idle returns.
+	void run(Job& job) {
+		if (!job.task) {
+			return;
+		}
+		// Only workers run queued jobs: callers outside the pool run their own chunks directly
+		Worker& self = *current_worker;
+		TraceRing* trace = self.trace.load(std::memory_order_acquire);
+		if (!CollectStats && !trace) {
+			job.task();
+			job.task.reset();
+			finish_jobs(1);
+			return;
+		}
+		int64_t start = now_ns();
+		if constexpr (CollectStats) {
+			self.counters.tasks_started.fetch_add(1, std::memory_order_relaxed);
+			self.counters.queue_wait[WorkerStats::queue_wait_bucket(start - job.queued_at)].fetch_add(
+				1, std::memory_order_relaxed);
+		}
+		job.task();
+		job.task.reset();
+		int64_t end = now_ns();
+		if constexpr (CollectStats) {
+			self.counters.busy_ns.fetch_add(end - start, std::memory_order_relaxed);
+			self.counters.tasks_executed.fetch_add(1, std::memory_order_relaxed);
+		}
+		if (trace) {
+			trace->record(job.label ? job.label : "task", start, end);
+		}
+		finish_jobs(1);
+	}
+
+	/// @brief Records the span of a blocking call on the thread that made it, while tracing
+	class TracedCall {
+	   public:
+		TracedCall(BasicThreadPool& pool, const char* label)
+			: pool(pool), label(label), start(pool.tracing.load(std::memory_order_relaxed) ? now_ns() : 0) {}
+
+		TracedCall(const TracedCall&) = delete;
+		TracedCall& operator=(const TracedCall&) = delete;
+
+		~TracedCall() {
+			if (start != 0) {
+				pool.record_call(label, start, now_ns());
+			}
+		}
+
+	   private:
+		BasicThreadPool& pool;
+		const char* label;
+		int64_t start;
+	};
+
+	/// @brief Records a blocking call: on a worker in its own ring, otherwise in the shared caller log
+	void record_call(const char* label, int64_t begin_ns, int64_t end_ns) {
+		if (current_pool == this) {
+			if (TraceRing* trace = current_worker->trace.load(std::memory_order_acquire)) {
+				trace->record(label, begin_ns, end_ns);
+			}
+			return;
+		}
+		std::scoped_lock<std::mutex> lock(trace_lock);
+		if (!tracing.load(std::memory_order_relaxed)) {
+			return;
+		}
+		if (caller_events.size() == trace_capacity) {
+			caller_events.pop_front();
+		}
+		caller_events.emplace_back(std::this_thread::get_id(), TraceEvent{label, begin_ns, end_ns});
+	}
+
+	/// @brief Gives worker i a trace ring while tracing (trace_lock held)
+	void attach_trace(size_t i) {
+		if (trace_rings.size() <= i) {
+			trace_rings.resize(i + 1);
+		}
+		if (!trace_rings[i]) {
+			trace_rings[i] = std::make_unique<TraceRing>(trace_capacity);
+		}
+		workers[i]->trace.store(trace_rings[i].get(), std::memory_order_release);
+	}
+
+	/// @brief Writes a string as a JSON string literal
+	static void write_json_string(std::ostream& out, const char* text) {
+		out << '"';
+		for (; *text; text++) {
+			unsigned char c = static_cast<unsigned char>(*text);
+			if (c == '"' || c == '\\') {
+				out << '\\' << *text;
+			} else if (c < 0x20) {
+				static constexpr char hex[] = "0123456789abcdef";
+				out << "\\u00" << hex[c >> 4] << hex[c & 0xf];
+			} else {
+				out << *text;
+			}
+		}
+		out << '"';
+	}
+
+	/// @brief Writes nanoseconds as microseconds with three decimals, the unit of trace_event timestamps
+	static void write_micros(std::ostream& out, int64_t ns) {
+		ns = std::max<int64_t>(ns, 0);
+		out << ns / 1000 << '.' << static_cast<char>('0' + ns / 100 % 10) << static_cast<char>('0' + ns / 10 % 10)
+			<< static_cast<char>('0' + ns % 10);
+	}
+
+	/// @brief The counters of a worker, nullptr for no worker or without CollectStats
+	Counters* counters_of([[maybe_unused]] Worker* worker) noexcept {
+		if constexpr (CollectStats) {
+			return worker ? &worker->counters : nullptr;
+		} else {
+			return nullptr;
+		}
+	}
+
+	/// @brief Stops and joins the workers, then destroys the jobs still queued
+	/// @return The number of tasks destroyed without running
+	size_t stop_workers() {
+		timers->close();
+		if (timer_thread.joinable()) {
+			timer_thread.join();
+		}
+		{
+			std::scoped_lock<std::mutex> lock(resize_lock);
+			running = false;
+			// Reaches the tasks still running that take a std::stop_token
+			for (std::jthread& thread : threads) {
+				thread.request_stop();
+			}
+		}
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		wake_workers(max_threads);
+		for (auto& thread : threads) {
+			if (thread.joinable()) {
+				thread.join();
+			}
+		}
+		threads.clear();
+		size_t dropped = 0;
+		auto drop = [&](std::optional<Job> job) {
+			if (job && job->task) {
+				dropped++;
+			}
+		};
+		for (Lane& queue : lanes) {
+			while (!queue.empty()) {
+				drop(queue.try_pop());
+			}
+		}
+		for (LockedQueue<Job>& queue : pool_lanes) {
+			while (!queue.empty()) {
+				drop(queue.try_pop());
+			}
+		}
+		for (LockedQueue<Job>& queue : node_queues) {
+			while (!queue.empty()) {
+				drop(queue.try_pop());
+			}
+		}
+		for (size_t i = 0; i < num_slots.load(std::memory_order_relaxed); i++) {
+			while (std::optional<Job> job = workers[i]->pop()) {
+				drop(std::move(job));
+			}
+			while (std::optional<Job> job = workers[i]->inbox.try_pop()) {
+				drop(std::move(job));
+			}
+		}
+		local_jobs.store(0, std::memory_order_relaxed);
+		finish_jobs(dropped);
+		// The helper jobs of blocking calls are not tasks of their own: their callers finish or report the work
+		return dropped - dropped_helpers.exchange(0, std::memory_order_relaxed);
+	}
+
+	/// @brief Throws once the pool has been shut down, whose queues would never run what is added to them
+	void check_running() const {
+		if (!running.load(std::memory_order_acquire)) {
+			throw std::logic_error("Cannot add tasks to a thread pool that has been shut down");
+		}
+	}
+
+	/// @brief Throws if the calling thread is a worker of this pool, which could only wait for itself
+	void check_not_worker(const char* what) const {
+		if (current_pool == this) {
+			throw std::logic_error(std::string(what) + " called from a worker of the same pool");
+		}
+	}
+
+	void worker_loop(size_t index, std::stop_token stop) {
+		Worker& self = *workers[index];
+		self.stop = std::move(stop);
+		if (!self.cpus.empty()) {
+			pin_current_thread(self.cpus);
+		}
+		current_pool = this;
+		current_worker = &self;
+		while (running.load(std::memory_order_relaxed) && !self.retire.load(std::memory_order_relaxed)) {
+			poll_timers();
+			std::optional<Job> job = next_job(self);
+			if (!job) {
+				if constexpr (CollectStats) {
+					int64_t idle_start = now_ns();
+					job = wait_for_job(self);
+					self.counters.idle_ns.fetch_add(now_ns() - idle_start, std::memory_order_relaxed);
+				} else {
+					job = wait_for_job(self);
+				}
+			}
+			if (job) {
+				run(*job);
+			}
+		}
+		if (running.load(std::memory_order_relaxed)) {
+			hand_off_jobs(self);
+		}
+		self.exits.fetch_add(1, std::memory_order_release);
+		self.exits.notify_all();
+	}
+
+	/// @brief Moves a retiring worker's deque and pinned jobs to the global queue, and passes on any wakeup it
+	/// absorbed
+	void hand_off_jobs(Worker& self) {
+		while (std::optional<Job> job = self.pop()) {
+			local_jobs.fetch_sub(1, std::memory_order_relaxed);
+			requeue(std::move(*job));
+		}
+		hand_off_pinned(self);
+		if (work_available()) {
+			wake_workers(1);
+		}
+	}
+
+	static inline thread_local BasicThreadPool* current_pool = nullptr;
+	static inline thread_local Worker* current_worker = nullptr;
+	static inline thread_local BasicThreadPool* timer_pool = nullptr;  // set on a pool's dedicated timer thread
+
+	// Member groups are laid out so that data written by different threads never shares a cache line with data
+	// that is read on every job. The first group is read-mostly: fixed at construction or changed only by reset,
+	// shutdown and start_tracing.
+	SchedulingMode mode = SchedulingMode::global_queue;
+	IdlePolicy idle_policy;
+	const Affinity affinity;
+	const ElasticPolicy elastic;
+	const std::shared_ptr<TimerQueue> timers = std::make_shared<TimerQueue>(TimerPolicy{}.tick, false);
+	std::unique_ptr<std::unique_ptr<Worker>[]> workers = std::make_unique<std::unique_ptr<Worker>[]>(max_threads);
+	std::atomic<size_t> num_workers = 0;  // active workers, always workers [0, num_workers)
+	std::atomic<size_t> num_slots = 0;    // workers ever created, all of which may still hold jobs
+	std::atomic<bool> running = true;
+	std::atomic<bool> tracing = false;
+	std::atomic<size_t> idle_waiters = 0;
+	std::atomic<size_t> base_size = 0;  // written under resize_lock; workers at or above it were added by elastic
+	using Lane = typename QueuePolicy::template queue<Job>;
+
+	/// @brief Every this many calls to next_job a worker serves the lower lanes first
+	static constexpr uint32_t lane_aging_interval = 16;
+
+	Lane& lane(Priority priority) {
+		return lanes[static_cast<size_t>(priority)];
+	}
+
+	/// Whether only one thread outside the pool may push to the lanes (SingleProducerQueue)
+	static constexpr bool single_producer = requires { requires QueuePolicy::single_producer; };
+
+	/// @brief Whether the calling thread is one of the pool's own: a worker or the timer thread
+	bool on_pool_thread() const {
+		return current_pool == this || timer_pool == this;
+	}
+
+	/// @brief Pushes make(i) for i in [0, count) onto a global lane until it is full
+	/// @return The number of jobs pushed
+	///
+	/// With a single producer lane, the pool's own threads push onto the locked pool lane beside it instead.
+	template <typename Make>
+	size_t push_to_lane(Priority priority, size_t count, Make&& make) {
+		if constexpr (single_producer) {
+			if (on_pool_thread()) {
+				return pool_lanes[static_cast<size_t>(priority)].try_emplace_bulk(count, make);
+			}
+		}
+		return lane(priority).try_emplace_bulk(count, make);
+	}
+
+	/// @brief Pops from a global lane, or from the pool lane beside it
+	std::optional<Job> pop_lane(Priority priority) {
+		if (std::optional<Job> job = lane(priority).try_pop()) {
+			return job;
+		}
+		if constexpr (single_producer) {
+			return pool_lanes[static_cast<size_t>(priority)].try_pop();
+		}
+		return std::nullopt;
+	}
+
+	/// @brief Queues a job the pool moves itself in the normal lane, waiting for room if it is full
+	void requeue(Job&& job) {
+		while (push_to_lane(Priority::normal, 1, [&](size_t) { return std::move(job); }) == 0) {
+			std::this_thread::yield();
+		}
+	}
+
+	// Each queue starts on a line of its own (both queue types are cache line aligned)
+	std::array<Lane, 3> lanes;  // global queues indexed by Priority
+	std::array<LockedQueue<Job>, single_producer ? 3 : 0> pool_lanes;  // what the pool's own threads queue beside lanes
+	std::vector<LockedQueue<Job>> node_queues;  // one per NUMA node, empty without an Affinity
+
+	// Written by every submitter and every worker
+	THREADPOOL_HOT_ALIGN std::atomic<size_t> outstanding = 0;  // tasks queued or running
+	THREADPOOL_HOT_ALIGN std::atomic<size_t> local_jobs = 0;   // jobs across all worker deques
+	std::atomic<size_t> next_slice_worker = 0;  // rotates which worker gets the first slice of a batch
+	std::atomic<size_t> dropped_helpers = 0;    // helper jobs of blocking calls dropped by stop_workers
+	std::atomic<int64_t> backed_up_since = 0;   // steady_clock nanoseconds, 0 while not backed up
+
+	THREADPOOL_HOT_ALIGN std::mutex park_lock;
+	std::vector<Worker*> parked;       // guarded by park_lock
+	std::atomic<size_t> sleepers = 0;  // parked.size(), readable without the lock
+
+	// Cold: only touched by wait_idle, reset and tracing calls
+	THREADPOOL_HOT_ALIGN std::mutex idle_lock;
+	std::condition_variable idle_changed;
+	std::mutex resize_lock;
+	std::vector<std::jthread> threads;  // indexed like workers, guarded by resize_lock; retired ones are joined lazily
+	std::jthread timer_thread;          // only with TimerPolicy::dedicated_thread
+
+	// Tracing: one ring per worker slot, kept until the pool is destroyed since workers may still be writing
+	std::mutex trace_lock;
+	size_t trace_capacity = 0;                            // guarded by trace_lock
+	std::vector<std::unique_ptr<TraceRing>> trace_rings;  // indexed like workers, guarded by trace_lock
+	RingDeque<std::pair<std::thread::id, TraceEvent>> caller_events;  // guarded by trace_lock
+};
+
+/// @brief Thread pool with an unbounded, mutex protected global queue
+using ThreadPool = BasicThreadPool<>;
+
+/// @brief ThreadPool that keeps the counters returned by stats()
+using InstrumentedThreadPool = BasicThreadPool<UnboundedQueue, true>;
+
 #endif  // SIMULATOR_THREADPOOL_H
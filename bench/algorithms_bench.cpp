@@ -0,0 +1,128 @@
+// Parallel algorithms (reduce, transform, scan, sort) against std::execution::par
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <numeric>
+#include <random>
+#include <vector>
+
+#if THREADPOOL_BENCH_HAS_PAR
+#include <execution>
+#endif
+
+#include "bench_common.h"
+
+namespace {
+
+constexpr size_t algorithm_size = 1 << 20;
+
+std::vector<double> make_values() {
+	std::vector<double> values(algorithm_size);
+	std::mt19937_64 random(42);
+	std::uniform_real_distribution<double> distribution(0.0, 1.0);
+	for (double& value : values) {
+		value = distribution(random);
+	}
+	return values;
+}
+
+void BM_Reduce(benchmark::State& state) {
+	ThreadPool pool(static_cast<size_t>(state.range(0)));
+	std::vector<double> values = make_values();
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(pool.parallel_reduce(values.begin(), values.end(), 0.0, std::plus<>()));
+	}
+	state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * algorithm_size));
+}
+BENCHMARK(BM_Reduce)->Name("BM_Algorithm/reduce/pool")->Apply(thread_counts)->UseRealTime();
+
+void BM_Transform(benchmark::State& state) {
+	ThreadPool pool(static_cast<size_t>(state.range(0)));
+	std::vector<double> values = make_values();
+	std::vector<double> output(algorithm_size);
+	for (auto _ : state) {
+		pool.parallel_transform(values.begin(), values.end(), output.begin(), [](double x) { return x * x + 1.0; });
+	}
+	benchmark::DoNotOptimize(output.data());
+	state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * algorithm_size));
+}
+BENCHMARK(BM_Transform)->Name("BM_Algorithm/transform/pool")->Apply(thread_counts)->UseRealTime();
+
+void BM_Scan(benchmark::State& state) {
+	ThreadPool pool(static_cast<size_t>(state.range(0)));
+	std::vector<double> values = make_values();
+	std::vector<double> output(algorithm_size);
+	for (auto _ : state) {
+		pool.parallel_inclusive_scan(values.begin(), values.end(), output.begin());
+	}
+	benchmark::DoNotOptimize(output.data());
+	state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * algorithm_size));
+}
+BENCHMARK(BM_Scan)->Name("BM_Algorithm/inclusive_scan/pool")->Apply(thread_counts)->UseRealTime();
+
+void BM_Sort(benchmark::State& state) {
+	ThreadPool pool(static_cast<size_t>(state.range(0)));
+	std::vector<double> values = make_values();
+	std::vector<double> work;
+	for (auto _ : state) {
+		state.PauseTiming();
+		work = values;
+		state.ResumeTiming();
+		pool.parallel_sort(work.begin(), work.end());
+	}
+	benchmark::DoNotOptimize(work.data());
+	state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * algorithm_size));
+}
+BENCHMARK(BM_Sort)->Name("BM_Algorithm/sort/pool")->Apply(thread_counts)->UseRealTime();
+
+#if THREADPOOL_BENCH_HAS_PAR
+/// Baselines: the same algorithms with std::execution::par on the standard library's backend, all cores
+void BM_ReducePar(benchmark::State& state) {
+	std::vector<double> values = make_values();
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(std::reduce(std::execution::par, values.begin(), values.end(), 0.0));
+	}
+	state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * algorithm_size));
+}
+BENCHMARK(BM_ReducePar)->Name("BM_Algorithm/reduce/execution_par")->UseRealTime();
+
+void BM_TransformPar(benchmark::State& state) {
+	std::vector<double> values = make_values();
+	std::vector<double> output(algorithm_size);
+	for (auto _ : state) {
+		std::transform(std::execution::par, values.begin(), values.end(), output.begin(),
+					   [](double x) { return x * x + 1.0; });
+	}
+	benchmark::DoNotOptimize(output.data());
+	state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * algorithm_size));
+}
+BENCHMARK(BM_TransformPar)->Name("BM_Algorithm/transform/execution_par")->UseRealTime();
+
+void BM_ScanPar(benchmark::State& state) {
+	std::vector<double> values = make_values();
+	std::vector<double> output(algorithm_size);
+	for (auto _ : state) {
+		std::inclusive_scan(std::execution::par, values.begin(), values.end(), output.begin());
+	}
+	benchmark::DoNotOptimize(output.data());
+	state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * algorithm_size));
+}
+BENCHMARK(BM_ScanPar)->Name("BM_Algorithm/inclusive_scan/execution_par")->UseRealTime();
+
+void BM_SortPar(benchmark::State& state) {
+	std::vector<double> values = make_values();
+	std::vector<double> work;
+	for (auto _ : state) {
+		state.PauseTiming();
+		work = values;
+		state.ResumeTiming();
+		std::sort(std::execution::par, work.begin(), work.end());
+	}
+	benchmark::DoNotOptimize(work.data());
+	state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * algorithm_size));
+}
+BENCHMARK(BM_SortPar)->Name("BM_Algorithm/sort/execution_par")->UseRealTime();
+#endif
+
+}  // namespace
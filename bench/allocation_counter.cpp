@@ -0,0 +1,76 @@
+#include "allocation_counter.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// Replaces the global allocation functions so benchmarks can report allocations per task
+
+namespace {
+
+std::atomic<size_t> allocations = 0;
+
+void* counted_allocate(size_t size, size_t alignment) {
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	void* pointer = alignment <= alignof(std::max_align_t)
+						? std::malloc(size == 0 ? 1 : size)
+						: std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+	if (!pointer) {
+		throw std::bad_alloc();
+	}
+	return pointer;
+}
+
+}  // namespace
+
+size_t allocation_count() {
+	return allocations.load(std::memory_order_relaxed);
+}
+
+void* operator new(size_t size) {
+	return counted_allocate(size, alignof(std::max_align_t));
+}
+
+void* operator new[](size_t size) {
+	return counted_allocate(size, alignof(std::max_align_t));
+}
+
+void* operator new(size_t size, std::align_val_t alignment) {
+	return counted_allocate(size, static_cast<size_t>(alignment));
+}
+
+void* operator new[](size_t size, std::align_val_t alignment) {
+	return counted_allocate(size, static_cast<size_t>(alignment));
+}
+
+void operator delete(void* pointer) noexcept {
+	std::free(pointer);
+}
+
+void operator delete[](void* pointer) noexcept {
+	std::free(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept {
+	std::free(pointer);
+}
+
+void operator delete[](void* pointer, size_t) noexcept {
+	std::free(pointer);
+}
+
+void operator delete(void* pointer, std::align_val_t) noexcept {
+	std::free(pointer);
+}
+
+void operator delete[](void* pointer, std::align_val_t) noexcept {
+	std::free(pointer);
+}
+
+void operator delete(void* pointer, size_t, std::align_val_t) noexcept {
+	std::free(pointer);
+}
+
+void operator delete[](void* pointer, size_t, std::align_val_t) noexcept {
+	std::free(pointer);
+}
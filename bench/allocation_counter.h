@@ -0,0 +1,9 @@
+#ifndef THREADPOOL_BENCH_ALLOCATION_COUNTER_H
+#define THREADPOOL_BENCH_ALLOCATION_COUNTER_H
+
+#include <cstddef>
+
+/// @brief Number of calls to the global operator new so far, across all threads
+size_t allocation_count();
+
+#endif  // THREADPOOL_BENCH_ALLOCATION_COUNTER_H
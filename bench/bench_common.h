@@ -0,0 +1,35 @@
+#ifndef THREADPOOL_BENCH_COMMON_H
+#define THREADPOOL_BENCH_COMMON_H
+
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "ThreadPool.hpp"
+
+/// @brief Busy-waits for a duration, standing in for a task body of known cost
+inline void spin_for(std::chrono::nanoseconds duration) {
+	auto deadline = std::chrono::steady_clock::now() + duration;
+	while (std::chrono::steady_clock::now() < deadline) {
+	}
+}
+
+/// @brief Blocks until counter reaches target (used to wait for detached tasks)
+inline void wait_for_count(const std::atomic<size_t>& counter, size_t target) {
+	while (counter.load(std::memory_order_acquire) < target) {
+		std::this_thread::yield();
+	}
+}
+
+/// @brief Pool sizes from 1 to hardware_concurrency() in powers of two
+inline void thread_counts(benchmark::internal::Benchmark* benchmark) {
+	size_t max_threads = std::max(1u, std::thread::hardware_concurrency());
+	for (size_t threads = 1; threads < max_threads; threads *= 2) {
+		benchmark->Arg(static_cast<int64_t>(threads));
+	}
+	benchmark->Arg(static_cast<int64_t>(max_threads));
+}
+
+#endif  // THREADPOOL_BENCH_COMMON_H
@@ -0,0 +1,276 @@
+// Latency of the blocking API (run_tasks, run_loop, run_graph), with raw std::thread and std::execution::par baselines
+
+#include <algorithm>
+#include <functional>
+#include <numeric>
+#include <vector>
+
+#if THREADPOOL_BENCH_HAS_PAR
+#include <execution>
+#endif
+
+#include "allocation_counter.h"
+#include "bench_common.h"
+
+namespace {
+
+constexpr size_t batch_size = 256;
+constexpr size_t loop_size = 1 << 16;
+constexpr auto one_microsecond = std::chrono::microseconds(1);
+
+template <bool Busy>
+void BM_RunTasks(benchmark::State& state) {
+	ThreadPool pool(static_cast<size_t>(state.range(0)));
+	std::vector<std::function<void()>> tasks;
+	for (auto _ : state) {
+		tasks.assign(batch_size, [] {
+			if constexpr (Busy) {
+				spin_for(one_microsecond);
+			}
+		});
+		pool.run_tasks(tasks);
+	}
+	state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * batch_size));
+}
+BENCHMARK(BM_RunTasks<false>)->Name("BM_RunTasks/empty")->Apply(thread_counts)->UseRealTime();
+BENCHMARK(BM_RunTasks<true>)->Name("BM_RunTasks/1us")->Apply(thread_counts)->UseRealTime();
+
+/// A per-index body behind std::function, one indirect call per index
+void BM_RunLoopEmpty(benchmark::State& state) {
+	ThreadPool pool(static_cast<size_t>(state.range(0)));
+	std::vector<float> data(loop_size, 1.0f);
+	size_t allocations = 0;
+	for (auto _ : state) {
+		size_t before = allocation_count();
+		pool.run_loop(0, loop_size, std::function<void(size_t)>([&](size_t i) { data[i] += 1.0f; }));
+		allocations += allocation_count() - before;
+	}
+	benchmark::DoNotOptimize(data.data());
+	state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * loop_size));
+	state.counters["allocs_per_call"] =
+		static_cast<double>(allocations) / static_cast<double>(std::max<int64_t>(state.iterations(), 1));
+}
+BENCHMARK(BM_RunLoopEmpty)->Name("BM_RunLoop/empty")->Apply(thread_counts)->UseRealTime();
+
+/// The same per-index body as a plain lambda, inlined into the loop over each chunk
+void BM_RunLoopLambda(benchmark::State& state) {
+	ThreadPool pool(static_cast<size_t>(state.range(0)));
+	std::vector<float> data(loop_size, 1.0f);
+	for (auto _ : state) {
+		pool.run_loop(0, loop_size, [&](size_t i) { data[i] += 1.0f; });
+	}
+	benchmark::DoNotOptimize(data.data());
+	state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * loop_size));
+}
+BENCHMARK(BM_RunLoopLambda)->Name("BM_RunLoop/lambda")->Apply(thread_counts)->UseRealTime();
+
+void BM_RunLoopRange(benchmark::State& state) {
+	ThreadPool pool(static_cast<size_t>(state.range(0)));
+	std::vector<float> data(loop_size, 1.0f);
+	for (auto _ : state) {
+		pool.run_loop(0, loop_size, [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++) {
+				data[i] += 1.0f;
+			}
+		});
+	}
+	benchmark::DoNotOptimize(data.data());
+	state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * loop_size));
+}
+BENCHMARK(BM_RunLoopRange)->Name("BM_RunLoop/range")->Apply(thread_counts)->UseRealTime();
+
+template <Schedule S>
+void BM_RunLoopBusy(benchmark::State& state) {
+	ThreadPool pool(static_cast<size_t>(state.range(0)));
+	for (auto _ : state) {
+		pool.run_loop(
+			0, batch_size,
+			[](size_t begin, size_t end) {
+				for (size_t i = begin; i < end; i++) {
+					spin_for(one_microsecond);
+				}
+			},
+			S, 4);
+	}
+	state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * batch_size));
+}
+BENCHMARK(BM_RunLoopBusy<Schedule::static_blocks>)->Name("BM_RunLoop/1us/static")->Apply(thread_counts)->UseRealTime();
+BENCHMARK(BM_RunLoopBusy<Schedule::dynamic>)->Name("BM_RunLoop/1us/dynamic")->Apply(thread_counts)->UseRealTime();
+BENCHMARK(BM_RunLoopBusy<Schedule::guided>)->Name("BM_RunLoop/1us/guided")->Apply(thread_counts)->UseRealTime();
+BENCHMARK(BM_RunLoopBusy<Schedule::adaptive>)->Name("BM_RunLoop/1us/adaptive")->Apply(thread_counts)->UseRealTime();
+
+/// A cheap per-index body with the default grain of 1, where every chunk handed out costs as much as the work
+template <Schedule S>
+void BM_RunLoopCheap(benchmark::State& state) {
+	ThreadPool pool(static_cast<size_t>(state.range(0)));
+	std::vector<float> data(loop_size, 1.0f);
+	for (auto _ : state) {
+		pool.run_loop(0, loop_size, [&](size_t i) { data[i] += 1.0f; }, S);
+	}
+	benchmark::DoNotOptimize(data.data());
+	state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * loop_size));
+}
+BENCHMARK(BM_RunLoopCheap<Schedule::dynamic>)->Name("BM_RunLoop/cheap/dynamic")->Apply(thread_counts)->UseRealTime();
+BENCHMARK(BM_RunLoopCheap<Schedule::adaptive>)->Name("BM_RunLoop/cheap/adaptive")->Apply(thread_counts)->UseRealTime();
+
+/// Runs of 20ns indices between runs of 2us ones, the same grain of 1 for every schedule
+template <Schedule S>
+void BM_RunLoopUneven(benchmark::State& state) {
+	ThreadPool pool(static_cast<size_t>(state.range(0)));
+	constexpr size_t count = 4096;
+	for (auto _ : state) {
+		pool.run_loop(
+			0, count,
+			[](size_t i) {
+				spin_for(i / 512 % 4 == 0 ? std::chrono::nanoseconds(2000) : std::chrono::nanoseconds(20));
+			},
+			S);
+	}
+	state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * count));
+}
+BENCHMARK(BM_RunLoopUneven<Schedule::static_blocks>)
+	->Name("BM_RunLoop/uneven/static")
+	->Apply(thread_counts)
+	->UseRealTime();
+BENCHMARK(BM_RunLoopUneven<Schedule::dynamic>)->Name("BM_RunLoop/uneven/dynamic")->Apply(thread_counts)->UseRealTime();
+BENCHMARK(BM_RunLoopUneven<Schedule::guided>)->Name("BM_RunLoop/uneven/guided")->Apply(thread_counts)->UseRealTime();
+BENCHMARK(BM_RunLoopUneven<Schedule::adaptive>)
+	->Name("BM_RunLoop/uneven/adaptive")
+	->Apply(thread_counts)
+	->UseRealTime();
+
+/// run_loop inside run_loop tasks
+template <SchedulingMode Mode>
+void BM_RunLoopNested(benchmark::State& state) {
+	ThreadPool pool(static_cast<size_t>(state.range(0)), Mode);
+	constexpr size_t outer = 32;
+	std::vector<float> data(loop_size, 1.0f);
+	for (auto _ : state) {
+		pool.run_loop(
+			0, outer,
+			[&](size_t outer_begin, size_t outer_end) {
+				for (size_t o = outer_begin; o < outer_end; o++) {
+					size_t base = o * (loop_size / outer);
+					pool.run_loop(base, base + loop_size / outer, [&](size_t begin, size_t end) {
+						for (size_t i = begin; i < end; i++) {
+							data[i] += 1.0f;
+						}
+					});
+				}
+			},
+			Schedule::dynamic);
+	}
+	benchmark::DoNotOptimize(data.data());
+	state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * loop_size));
+}
+BENCHMARK(BM_RunLoopNested<SchedulingMode::global_queue>)
+	->Name("BM_RunLoop/nested/global_queue")
+	->Apply(thread_counts)
+	->UseRealTime();
+BENCHMARK(BM_RunLoopNested<SchedulingMode::work_stealing>)
+	->Name("BM_RunLoop/nested/work_stealing")
+	->Apply(thread_counts)
+	->UseRealTime();
+
+constexpr size_t pipeline_stages = 4;
+constexpr size_t pipeline_width = 16;
+
+/// A pipeline of stages whose piece i only depends on piece i of the previous stage, with uneven piece costs
+auto pipeline_piece(size_t piece) {
+	return [piece] { spin_for(one_microsecond * (1 + piece % 4)); };
+}
+
+/// The pipeline as one run_tasks barrier per stage
+void BM_PipelineBarriers(benchmark::State& state) {
+	ThreadPool pool(static_cast<size_t>(state.range(0)), SchedulingMode::work_stealing);
+	std::vector<std::function<void()>> tasks;
+	for (auto _ : state) {
+		for (size_t stage = 0; stage < pipeline_stages; stage++) {
+			tasks.clear();
+			for (size_t piece = 0; piece < pipeline_width; piece++) {
+				tasks.emplace_back(pipeline_piece(piece + stage));
+			}
+			pool.run_tasks(tasks);
+		}
+	}
+	state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * pipeline_stages * pipeline_width));
+}
+BENCHMARK(BM_PipelineBarriers)->Name("BM_Pipeline/barriers")->Apply(thread_counts)->UseRealTime();
+
+/// The same pipeline as a TaskGraph, built once and re-run
+void BM_PipelineGraph(benchmark::State& state) {
+	ThreadPool pool(static_cast<size_t>(state.range(0)), SchedulingMode::work_stealing);
+	TaskGraph graph;
+	for (size_t stage = 0; stage < pipeline_stages; stage++) {
+		for (size_t piece = 0; piece < pipeline_width; piece++) {
+			TaskGraph::NodeId node = graph.add_node(pipeline_piece(piece + stage));
+			if (stage > 0) {
+				graph.add_edge(static_cast<TaskGraph::NodeId>(node - pipeline_width), node);
+			}
+		}
+	}
+	size_t allocations = 0;
+	for (auto _ : state) {
+		size_t before = allocation_count();
+		pool.run_graph(graph);
+		allocations += allocation_count() - before;
+	}
+	state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * pipeline_stages * pipeline_width));
+	state.counters["allocs_per_call"] =
+		static_cast<double>(allocations) / static_cast<double>(std::max<int64_t>(state.iterations(), 1));
+}
+BENCHMARK(BM_PipelineGraph)->Name("BM_Pipeline/graph")->Apply(thread_counts)->UseRealTime();
+
+/// Baseline: spawn and join std::threads for every loop
+template <bool Busy>
+void BM_RawThreads(benchmark::State& state) {
+	size_t num_threads = static_cast<size_t>(state.range(0));
+	size_t count = Busy ? batch_size : loop_size;
+	std::vector<float> data(count, 1.0f);
+	std::vector<std::thread> threads;
+	for (auto _ : state) {
+		for (size_t t = 0; t < num_threads; t++) {
+			threads.emplace_back([&, t] {
+				for (size_t i = t * count / num_threads; i < (t + 1) * count / num_threads; i++) {
+					if constexpr (Busy) {
+						spin_for(one_microsecond);
+					} else {
+						data[i] += 1.0f;
+					}
+				}
+			});
+		}
+		for (auto& thread : threads) {
+			thread.join();
+		}
+		threads.clear();
+	}
+	benchmark::DoNotOptimize(data.data());
+	state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * count));
+}
+BENCHMARK(BM_RawThreads<false>)->Name("BM_Baseline/std_thread/range")->Apply(thread_counts)->UseRealTime();
+BENCHMARK(BM_RawThreads<true>)->Name("BM_Baseline/std_thread/1us")->Apply(thread_counts)->UseRealTime();
+
+#if THREADPOOL_BENCH_HAS_PAR
+/// Baseline: std::execution::par on the standard library's backend (TBB for libstdc++), all cores
+template <bool Busy>
+void BM_ExecutionPar(benchmark::State& state) {
+	size_t count = Busy ? batch_size : loop_size;
+	std::vector<float> data(count, 1.0f);
+	for (auto _ : state) {
+		std::for_each(std::execution::par, data.begin(), data.end(), [](float& value) {
+			if constexpr (Busy) {
+				spin_for(one_microsecond);
+			} else {
+				value += 1.0f;
+			}
+		});
+	}
+	benchmark::DoNotOptimize(data.data());
+	state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * count));
+}
+BENCHMARK(BM_ExecutionPar<false>)->Name("BM_Baseline/execution_par/range")->UseRealTime();
+BENCHMARK(BM_ExecutionPar<true>)->Name("BM_Baseline/execution_par/1us")->UseRealTime();
+#endif
+
+}  // namespace
@@ -0,0 +1,102 @@
+// Cache line contention at 16 and more threads: padded against packed counters, and the pool's shared state
+// under many workers. This file is also built as thread_pool_layout_bench_packed with THREADPOOL_PACKED_LAYOUT,
+// which drops the padding of the pool's own hot members, so the pool benchmarks compare both layouts
+
+#include <array>
+#include <vector>
+
+#include "bench_common.h"
+
+namespace {
+
+#if defined(THREADPOOL_PACKED_LAYOUT)
+#define POOL_LAYOUT "packed_pool"
+#else
+#define POOL_LAYOUT "padded_pool"
+#endif
+
+constexpr size_t increments_per_iteration = 1 << 12;
+constexpr size_t tasks_per_iteration = 4096;
+
+/// @brief Worker counts that spread the pool's shared state over many cores, whatever the machine has
+void many_thread_counts(benchmark::internal::Benchmark* benchmark) {
+	benchmark->Arg(16)->Arg(32);
+}
+
+struct alignas(cache_line_size) PaddedCounter {
+	std::atomic<size_t> value = 0;
+};
+
+// The counter comparison does not depend on the pool's layout, so only the default build runs it
+#if !defined(THREADPOOL_PACKED_LAYOUT)
+struct PackedCounter {
+	std::atomic<size_t> value = 0;
+};
+
+/// One counter per benchmark thread, never shared, so any slowdown with more threads is false sharing
+template <typename Counter>
+void BM_PerThreadCounters(benchmark::State& state) {
+	static std::array<Counter, 64> counters;
+	Counter& mine = counters[static_cast<size_t>(state.thread_index()) % counters.size()];
+	for (auto _ : state) {
+		for (size_t i = 0; i < increments_per_iteration; i++) {
+			mine.value.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+	state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * increments_per_iteration));
+}
+BENCHMARK(BM_PerThreadCounters<PackedCounter>)
+	->Name("BM_Layout/counters/packed")
+	->Threads(1)
+	->Threads(16)
+	->Threads(32)
+	->UseRealTime();
+BENCHMARK(BM_PerThreadCounters<PaddedCounter>)
+	->Name("BM_Layout/counters/padded")
+	->Threads(1)
+	->Threads(16)
+	->Threads(32)
+	->UseRealTime();
+#endif
+
+/// Tiny tasks from outside the pool, so every job touches the queues, outstanding and the parking state
+template <SchedulingMode Mode>
+void BM_ManyWorkersDetach(benchmark::State& state) {
+	ThreadPool pool(static_cast<size_t>(state.range(0)), Mode);
+	std::atomic<size_t> done = 0;
+	size_t target = 0;
+	for (auto _ : state) {
+		pool.detach_tasks(tasks_per_iteration, [&done](size_t) {
+			return [&done] { done.fetch_add(1, std::memory_order_relaxed); };
+		});
+		target += tasks_per_iteration;
+		wait_for_count(done, target);
+	}
+	state.SetItemsProcessed(static_cast<int64_t>(target));
+}
+BENCHMARK(BM_ManyWorkersDetach<SchedulingMode::global_queue>)
+	->Name("BM_Layout/detach/global_queue/" POOL_LAYOUT)
+	->Apply(many_thread_counts)
+	->UseRealTime();
+BENCHMARK(BM_ManyWorkersDetach<SchedulingMode::work_stealing>)
+	->Name("BM_Layout/detach/work_stealing/" POOL_LAYOUT)
+	->Apply(many_thread_counts)
+	->UseRealTime();
+
+/// One index per chunk, so the workers hammer the loop's shared position and the pool's counters
+void BM_ManyWorkersRunLoop(benchmark::State& state) {
+	ThreadPool pool(static_cast<size_t>(state.range(0)), SchedulingMode::work_stealing);
+	std::vector<PaddedCounter> hits(static_cast<size_t>(state.range(0)) + 1);
+	for (auto _ : state) {
+		pool.run_loop(
+			0, tasks_per_iteration,
+			[&](size_t begin, size_t end) {
+				hits[begin % hits.size()].value.fetch_add(end - begin, std::memory_order_relaxed);
+			},
+			Schedule::dynamic, 1);
+	}
+	state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * tasks_per_iteration));
+}
+BENCHMARK(BM_ManyWorkersRunLoop)->Name("BM_Layout/run_loop/dynamic/" POOL_LAYOUT)->Apply(many_thread_counts)->UseRealTime();
+
+}  // namespace
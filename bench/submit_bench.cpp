@@ -0,0 +1,233 @@
+// Throughput of the non-blocking API: detach_task, detach_tasks, submit, strands, timers and coroutine hops
+
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include "allocation_counter.h"
+#include "bench_common.h"
+
+namespace {
+
+constexpr size_t tasks_per_iteration = 4096;
+
+template <typename Pool, SchedulingMode Mode>
+void BM_DetachTask(benchmark::State& state) {
+	Pool pool(static_cast<size_t>(state.range(0)), Mode);
+	std::atomic<size_t> done = 0;
+	size_t target = 0;
+	size_t allocations = 0;
+	for (auto _ : state) {
+		size_t before = allocation_count();
+		for (size_t i = 0; i < tasks_per_iteration; i++) {
+			pool.detach_task([&done] { done.fetch_add(1, std::memory_order_release); });
+		}
+		allocations += allocation_count() - before;
+		target += tasks_per_iteration;
+		wait_for_count(done, target);
+	}
+	state.SetItemsProcessed(static_cast<int64_t>(target));
+	state.counters["allocs_per_task"] = static_cast<double>(allocations) / static_cast<double>(target);
+}
+BENCHMARK(BM_DetachTask<ThreadPool, SchedulingMode::global_queue>)->Apply(thread_counts)->UseRealTime();
+BENCHMARK(BM_DetachTask<ThreadPool, SchedulingMode::work_stealing>)->Apply(thread_counts)->UseRealTime();
+BENCHMARK(BM_DetachTask<InstrumentedThreadPool, SchedulingMode::work_stealing>)->Apply(thread_counts)->UseRealTime();
+BENCHMARK(BM_DetachTask<BasicThreadPool<BoundedQueue<>>, SchedulingMode::global_queue>)
+	->Apply(thread_counts)
+	->UseRealTime();
+BENCHMARK(BM_DetachTask<BasicThreadPool<SingleProducerQueue<>>, SchedulingMode::global_queue>)
+	->Apply(thread_counts)
+	->UseRealTime();
+
+/// Tasks capturing more than the inline buffer, to show the heap fallback
+void BM_DetachTaskLargeCapture(benchmark::State& state) {
+	ThreadPool pool(static_cast<size_t>(state.range(0)));
+	std::atomic<size_t> done = 0;
+	size_t target = 0;
+	size_t allocations = 0;
+	std::array<char, 2 * THREADPOOL_TASK_BUFFER_SIZE> payload{};
+	for (auto _ : state) {
+		size_t before = allocation_count();
+		for (size_t i = 0; i < tasks_per_iteration; i++) {
+			pool.detach_task([&done, payload] {
+				benchmark::DoNotOptimize(payload);
+				done.fetch_add(1, std::memory_order_release);
+			});
+		}
+		allocations += allocation_count() - before;
+		target += tasks_per_iteration;
+		wait_for_count(done, target);
+	}
+	state.SetItemsProcessed(static_cast<int64_t>(target));
+	state.counters["allocs_per_task"] = static_cast<double>(allocations) / static_cast<double>(target);
+}
+BENCHMARK(BM_DetachTaskLargeCapture)->Apply(thread_counts)->UseRealTime();
+
+/// Tasks submitted from inside a task, which stay on the submitting worker in work stealing mode
+template <SchedulingMode Mode>
+void BM_DetachTaskNested(benchmark::State& state) {
+	ThreadPool pool(static_cast<size_t>(state.range(0)), Mode);
+	std::atomic<size_t> done = 0;
+	size_t target = 0;
+	constexpr size_t spawners = 64;
+	for (auto _ : state) {
+		for (size_t i = 0; i < spawners; i++) {
+			pool.detach_task([&] {
+				for (size_t j = 0; j < tasks_per_iteration / spawners; j++) {
+					pool.detach_task([&done] { done.fetch_add(1, std::memory_order_release); });
+				}
+			});
+		}
+		target += tasks_per_iteration;
+		wait_for_count(done, target);
+	}
+	state.SetItemsProcessed(static_cast<int64_t>(target));
+}
+BENCHMARK(BM_DetachTaskNested<SchedulingMode::global_queue>)->Apply(thread_counts)->UseRealTime();
+BENCHMARK(BM_DetachTaskNested<SchedulingMode::work_stealing>)->Apply(thread_counts)->UseRealTime();
+
+void BM_DetachTasks(benchmark::State& state) {
+	ThreadPool pool(static_cast<size_t>(state.range(0)));
+	std::atomic<size_t> done = 0;
+	size_t target = 0;
+	size_t allocations = 0;
+	std::vector<std::function<void()>> tasks;
+	tasks.reserve(tasks_per_iteration);
+	for (auto _ : state) {
+		size_t before = allocation_count();
+		tasks.clear();
+		for (size_t i = 0; i < tasks_per_iteration; i++) {
+			tasks.emplace_back([&done] { done.fetch_add(1, std::memory_order_release); });
+		}
+		pool.detach_tasks(tasks);
+		allocations += allocation_count() - before;
+		target += tasks_per_iteration;
+		wait_for_count(done, target);
+	}
+	state.SetItemsProcessed(static_cast<int64_t>(target));
+	state.counters["allocs_per_task"] = static_cast<double>(allocations) / static_cast<double>(target);
+}
+BENCHMARK(BM_DetachTasks)->Name("BM_DetachTasks/function_vector")->Apply(thread_counts)->UseRealTime();
+
+/// The same batch made by a generator straight into the queues (split across the deques in work stealing mode)
+template <SchedulingMode Mode>
+void BM_DetachTasksGenerator(benchmark::State& state) {
+	ThreadPool pool(static_cast<size_t>(state.range(0)), Mode);
+	std::atomic<size_t> done = 0;
+	size_t target = 0;
+	size_t allocations = 0;
+	for (auto _ : state) {
+		size_t before = allocation_count();
+		pool.detach_tasks(tasks_per_iteration, [&done](size_t) {
+			return [&done] { done.fetch_add(1, std::memory_order_release); };
+		});
+		allocations += allocation_count() - before;
+		target += tasks_per_iteration;
+		wait_for_count(done, target);
+	}
+	state.SetItemsProcessed(static_cast<int64_t>(target));
+	state.counters["allocs_per_task"] = static_cast<double>(allocations) / static_cast<double>(target);
+}
+BENCHMARK(BM_DetachTasksGenerator<SchedulingMode::global_queue>)
+	->Name("BM_DetachTasks/generator/global_queue")
+	->Apply(thread_counts)
+	->UseRealTime();
+BENCHMARK(BM_DetachTasksGenerator<SchedulingMode::work_stealing>)
+	->Name("BM_DetachTasks/generator/work_stealing")
+	->Apply(thread_counts)
+	->UseRealTime();
+
+void BM_Submit(benchmark::State& state) {
+	ThreadPool pool(static_cast<size_t>(state.range(0)));
+	std::vector<TaskFuture<size_t>> futures;
+	futures.reserve(tasks_per_iteration);
+	size_t allocations = 0;
+	size_t tasks = 0;
+	for (auto _ : state) {
+		futures.clear();
+		size_t before = allocation_count();
+		for (size_t i = 0; i < tasks_per_iteration; i++) {
+			futures.push_back(pool.submit([i] { return i; }));
+		}
+		allocations += allocation_count() - before;
+		wait_all(futures);
+		tasks += tasks_per_iteration;
+	}
+	state.SetItemsProcessed(static_cast<int64_t>(tasks));
+	state.counters["allocs_per_task"] = static_cast<double>(allocations) / static_cast<double>(tasks);
+}
+BENCHMARK(BM_Submit)->Apply(thread_counts)->UseRealTime();
+
+/// Tasks that must not overlap, serialized by a strand or by a mutex that blocks the workers waiting for it
+template <bool UseStrand>
+void BM_Serialized(benchmark::State& state) {
+	ThreadPool pool(static_cast<size_t>(state.range(0)), SchedulingMode::work_stealing);
+	ThreadPool::Strand strand(pool);
+	std::mutex lock;
+	std::atomic<size_t> done = 0;
+	size_t target = 0;
+	size_t counter = 0;
+	for (auto _ : state) {
+		for (size_t i = 0; i < tasks_per_iteration; i++) {
+			if constexpr (UseStrand) {
+				strand.detach_task([&] {
+					counter++;
+					done.fetch_add(1, std::memory_order_release);
+				});
+			} else {
+				pool.detach_task([&] {
+					std::scoped_lock<std::mutex> guard(lock);
+					counter++;
+					done.fetch_add(1, std::memory_order_release);
+				});
+			}
+		}
+		target += tasks_per_iteration;
+		wait_for_count(done, target);
+	}
+	benchmark::DoNotOptimize(counter);
+	state.SetItemsProcessed(static_cast<int64_t>(target));
+}
+BENCHMARK(BM_Serialized<true>)->Name("BM_Serialized/strand")->Apply(thread_counts)->UseRealTime();
+BENCHMARK(BM_Serialized<false>)->Name("BM_Serialized/mutex")->Apply(thread_counts)->UseRealTime();
+
+/// Arming and cancelling timers spread over every level of the timer wheel, none of which fires
+void BM_ScheduleAfterCancel(benchmark::State& state) {
+	ThreadPool pool(static_cast<size_t>(state.range(0)));
+	std::vector<ScheduledTask> timers(tasks_per_iteration);
+	for (auto _ : state) {
+		for (size_t i = 0; i < tasks_per_iteration; i++) {
+			auto delay = std::chrono::milliseconds(1000 + (i * 7919) % 10000000);
+			timers[i] = pool.schedule_after(delay, [] {});
+		}
+		for (ScheduledTask& timer : timers) {
+			timer.cancel();
+		}
+	}
+	state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * tasks_per_iteration));
+}
+BENCHMARK(BM_ScheduleAfterCancel)->Arg(1)->UseRealTime();
+
+AsyncTask<size_t> hop_repeatedly(ThreadPool& pool, size_t hops) {
+	for (size_t i = 0; i < hops; i++) {
+		co_await pool.schedule();
+	}
+	co_return hops;
+}
+
+/// A coroutine moving onto the pool with co_await pool.schedule(), over and over
+void BM_ScheduleHop(benchmark::State& state) {
+	ThreadPool pool(static_cast<size_t>(state.range(0)));
+	size_t allocations = 0;
+	size_t hops = 0;
+	for (auto _ : state) {
+		size_t before = allocation_count();
+		hops += sync_wait(hop_repeatedly(pool, tasks_per_iteration));
+		allocations += allocation_count() - before;
+	}
+	state.SetItemsProcessed(static_cast<int64_t>(hops));
+	state.counters["allocs_per_hop"] = static_cast<double>(allocations) / static_cast<double>(hops);
+}
+BENCHMARK(BM_ScheduleHop)->Apply(thread_counts)->UseRealTime();
+
+}  // namespace
@@ -0,0 +1,40 @@
+// Cost of waking parked workers for a batch, against the batch size
+
+#include <functional>
+#include <vector>
+
+#include "bench_common.h"
+
+namespace {
+
+/// Every worker is parked when the batch arrives; only the batch itself is timed
+void BM_WakeupParked(benchmark::State& state) {
+	size_t batch = static_cast<size_t>(state.range(0));
+	ThreadPool pool(std::max(1u, std::thread::hardware_concurrency()), SchedulingMode::global_queue,
+					IdlePolicy{0, 0});
+	std::vector<std::function<void()>> tasks;
+	for (auto _ : state) {
+		state.PauseTiming();
+		tasks.assign(batch, [] {});
+		std::this_thread::sleep_for(std::chrono::microseconds(200));
+		state.ResumeTiming();
+		pool.run_tasks(tasks);
+	}
+	state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * batch));
+}
+BENCHMARK(BM_WakeupParked)->RangeMultiplier(2)->Range(1, 64)->UseRealTime();
+
+/// Same batches with workers spinning between them (default IdlePolicy)
+void BM_WakeupSpinning(benchmark::State& state) {
+	size_t batch = static_cast<size_t>(state.range(0));
+	ThreadPool pool(std::max(1u, std::thread::hardware_concurrency()));
+	std::vector<std::function<void()>> tasks;
+	for (auto _ : state) {
+		tasks.assign(batch, [] {});
+		pool.run_tasks(tasks);
+	}
+	state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * batch));
+}
+BENCHMARK(BM_WakeupSpinning)->RangeMultiplier(2)->Range(1, 64)->UseRealTime();
+
+}  // namespace
@@ -0,0 +1,16 @@
+#ifndef THREADPOOL_TEST_CHECK_H
+#define THREADPOOL_TEST_CHECK_H
+
+#include <cstdio>
+#include <cstdlib>
+
+/// @brief Aborts with the failed condition and its location, also in release builds (unlike assert)
+#define CHECK(condition)                                                                    \
+	do {                                                                                    \
+		if (!(condition)) {                                                                 \
+			std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+			std::abort();                                                                   \
+		}                                                                                   \
+	} while (false)
+
+#endif  // THREADPOOL_TEST_CHECK_H
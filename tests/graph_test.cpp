@@ -0,0 +1,116 @@
+// run_graph: every node runs once per run after all of its predecessors, a cycle is rejected, and the nodes
+// after a failure are skipped with OnError::cancel
+
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+#include "ThreadPool.hpp"
+#include "check.h"
+
+namespace {
+
+/// A layered graph, whose nodes each wait for three nodes of the layer before, run three times
+void runs_after_predecessors(size_t threads, SchedulingMode mode) {
+	constexpr TaskGraph::NodeId layers = 6;
+	constexpr TaskGraph::NodeId width = 8;
+	ThreadPool pool(threads, mode);
+	TaskGraph graph;
+	std::atomic<size_t> clock = 0;
+	std::vector<size_t> started(layers * width);
+	std::vector<size_t> finished(layers * width);
+	std::vector<std::atomic<int>> runs(layers * width);
+	for (TaskGraph::NodeId id = 0; id < layers * width; id++) {
+		graph.add_node([&, id] {
+			started[id] = clock.fetch_add(1);
+			runs[id].fetch_add(1);
+			finished[id] = clock.fetch_add(1);
+		});
+	}
+	std::vector<std::pair<TaskGraph::NodeId, TaskGraph::NodeId>> edges;
+	for (TaskGraph::NodeId layer = 1; layer < layers; layer++) {
+		for (TaskGraph::NodeId i = 0; i < width; i++) {
+			for (TaskGraph::NodeId before : {i, (i + 1) % width, (i + 3) % width}) {
+				edges.emplace_back((layer - 1) * width + before, layer * width + i);
+			}
+		}
+	}
+	for (auto [before, after] : edges) {
+		graph.add_edge(before, after);
+	}
+	for (int run = 1; run <= 3; run++) {
+		pool.run_graph(graph);
+		for (const auto& count : runs) {
+			CHECK(count.load() == run);
+		}
+		for (auto [before, after] : edges) {
+			CHECK(finished[before] < started[after]);
+		}
+	}
+}
+
+/// A cycle is reported before any node runs
+void cycle_rejected() {
+	ThreadPool pool(2);
+	TaskGraph graph;
+	std::atomic<int> ran = 0;
+	TaskGraph::NodeId a = graph.add_node([&] { ran.fetch_add(1); });
+	TaskGraph::NodeId b = graph.add_node([&] { ran.fetch_add(1); });
+	TaskGraph::NodeId c = graph.add_node([&] { ran.fetch_add(1); });
+	graph.add_node([&] { ran.fetch_add(1); });
+	graph.add_edge(a, b);
+	graph.add_edge(b, c);
+	graph.add_edge(c, a);
+	bool rejected = false;
+	try {
+		pool.run_graph(graph);
+	} catch (const std::invalid_argument&) {
+		rejected = true;
+	}
+	CHECK(rejected);
+	CHECK(ran.load() == 0);
+}
+
+/// The nodes after a failing one still run with OnError::finish and are skipped with OnError::cancel; either
+/// way the node's exception is rethrown
+void failure_skips_successors(OnError on_error) {
+	ThreadPool pool(2);
+	TaskGraph graph;
+	std::atomic<int> after_failure = 0;
+	TaskGraph::NodeId root = graph.add_node([] {});
+	TaskGraph::NodeId failing = graph.add_node([] { throw std::runtime_error("node"); });
+	TaskGraph::NodeId successor = graph.add_node([&] { after_failure.fetch_add(1); });
+	TaskGraph::NodeId last = graph.add_node([&] { after_failure.fetch_add(1); });
+	graph.add_edge(root, failing);
+	graph.add_edge(failing, successor);
+	graph.add_edge(successor, last);
+	bool thrown = false;
+	try {
+		pool.run_graph(graph, on_error);
+	} catch (const std::runtime_error&) {
+		thrown = true;
+	}
+	CHECK(thrown);
+	CHECK(after_failure.load() == (on_error == OnError::finish ? 2 : 0));
+	// The graph can run again after a failed run
+	thrown = false;
+	try {
+		pool.run_graph(graph, on_error);
+	} catch (const std::runtime_error&) {
+		thrown = true;
+	}
+	CHECK(thrown);
+}
+
+}  // namespace
+
+int main() {
+	for (size_t threads : {1, 4}) {
+		runs_after_predecessors(threads, SchedulingMode::work_stealing);
+		runs_after_predecessors(threads, SchedulingMode::global_queue);
+	}
+	cycle_rejected();
+	failure_skips_successors(OnError::finish);
+	failure_skips_successors(OnError::cancel);
+	return 0;
+}
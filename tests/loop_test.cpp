@@ -0,0 +1,97 @@
+// run_loop from outside a saturated pool, which must not wait for the helper jobs no worker has started, and
+// Schedule::adaptive covering every index exactly once however uneven the body
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "ThreadPool.hpp"
+#include "check.h"
+
+namespace {
+
+/// The caller runs the whole loop itself and returns long before the busy workers get to its helpers
+void saturated_pool_does_not_delay_caller() {
+	using namespace std::chrono;
+	ThreadPool pool(2);
+	std::atomic<size_t> busy = 0;
+	for (size_t i = 0; i < pool.size(); i++) {
+		pool.detach_task([&] {
+			busy.fetch_add(1);
+			std::this_thread::sleep_for(seconds(1));
+		});
+	}
+	while (busy.load() < pool.size()) {
+		std::this_thread::sleep_for(milliseconds(1));
+	}
+	std::atomic<size_t> sum = 0;
+	steady_clock::time_point start = steady_clock::now();
+	pool.run_loop(0, 10, [&](size_t i) { sum.fetch_add(i); });
+	steady_clock::duration took = steady_clock::now() - start;
+	CHECK(sum.load() == 45);
+	CHECK(took < milliseconds(500));
+	// The helpers still run (as no-ops) once the workers are free
+	pool.wait_idle();
+}
+
+/// @brief Spins for about ns nanoseconds
+void spin_for(int64_t ns) {
+	auto until = std::chrono::steady_clock::now() + std::chrono::nanoseconds(ns);
+	while (std::chrono::steady_clock::now() < until) {
+	}
+}
+
+/// Each index is run once, for ranges shorter and longer than the participants, with a body whose cost varies by
+/// orders of magnitude along the range; every loop after the first starts from the cost the one before measured
+void adaptive_covers_each_index_once() {
+	for (size_t threads : {1, 3, 8}) {
+		ThreadPool pool(threads);
+		for (size_t start : {0, 1000}) {
+			for (size_t count : {1, 5, 1000, 20'000}) {
+				for (size_t grain : {1, 7}) {
+					std::vector<std::atomic<int>> hits(count);
+					pool.run_loop(
+						start, start + count,
+						[&](size_t i) {
+							size_t offset = i - start;
+							// The first tenth of the range is heavy, and so is every 97th index after it
+							if (offset < count / 10 || offset % 97 == 0) {
+								spin_for(5'000);
+							}
+							hits[offset].fetch_add(1);
+						},
+						Schedule::adaptive, grain);
+					for (const auto& hit : hits) {
+						CHECK(hit.load() == 1);
+					}
+				}
+			}
+		}
+		// A body taking a sub-range, nested inside a task
+		std::vector<std::atomic<int>> hits(10'000);
+		pool.submit([&] {
+				pool.run_loop(
+					0, hits.size(),
+					[&](size_t begin, size_t end) {
+						CHECK(begin < end);
+						for (size_t i = begin; i < end; i++) {
+							hits[i].fetch_add(1);
+						}
+					},
+					Schedule::adaptive);
+			})
+			.get();
+		for (const auto& hit : hits) {
+			CHECK(hit.load() == 1);
+		}
+	}
+}
+
+}  // namespace
+
+int main() {
+	saturated_pool_does_not_delay_caller();
+	adaptive_covers_each_index_once();
+	return 0;
+}
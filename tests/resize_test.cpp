@@ -0,0 +1,109 @@
+// Shrinking the pool while it grows again, from reset() and from elastic sizing
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "ThreadPool.hpp"
+#include "check.h"
+
+namespace {
+
+/// A grow reusing the slots of workers that a shrink has retired but that are still finishing their task: the shrink
+/// must still return, and the grown pool must keep running tasks
+void grow_while_shrink_waits() {
+	ThreadPool pool(4);
+	std::atomic<bool> release = false;
+	std::atomic<size_t> busy = 0;
+	for (int i = 0; i < 4; i++) {
+		pool.detach_task([&] {
+			busy.fetch_add(1);
+			while (!release.load()) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+		});
+	}
+	while (busy.load() < 4) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	std::thread shrinker([&] { pool.reset(2); });
+	while (pool.size() != 2) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	// The grow waits for the retiring workers to finish, so their tasks end from another thread
+	std::thread releaser([&] {
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		release = true;
+	});
+	pool.reset(4);
+	releaser.join();
+	shrinker.join();
+	CHECK(pool.size() == 4);
+	std::atomic<size_t> done = 0;
+	for (int i = 0; i < 64; i++) {
+		pool.detach_task([&] { done.fetch_add(1); });
+	}
+	pool.wait_idle();
+	CHECK(done.load() == 64);
+}
+
+/// Two threads resetting the pool to different sizes while tasks keep arriving
+void concurrent_resets() {
+	ThreadPool pool(4);
+	std::atomic<bool> stop = false;
+	std::thread feeder([&] {
+		while (!stop.load()) {
+			pool.detach_task([] {
+				auto until = std::chrono::steady_clock::now() + std::chrono::microseconds(200);
+				while (std::chrono::steady_clock::now() < until) {
+				}
+			});
+			std::this_thread::yield();
+		}
+	});
+	std::thread grower([&] {
+		for (int i = 0; i < 200; i++) {
+			pool.reset(4);
+		}
+	});
+	for (int i = 0; i < 200; i++) {
+		pool.reset(2);
+	}
+	grower.join();
+	stop = true;
+	feeder.join();
+	pool.wait_idle();
+	CHECK(pool.size() == 2 || pool.size() == 4);
+}
+
+/// Elastic growth reusing the slots a shrinking reset() retires
+void shrink_while_elastic_grows() {
+	ElasticPolicy elastic{.max_threads = 8, .queue_depth = 1, .grow_after = std::chrono::microseconds(1)};
+	ThreadPool pool(4, SchedulingMode::work_stealing, {}, {}, elastic);
+	std::atomic<size_t> done = 0;
+	size_t submitted = 0;
+	for (int round = 0; round < 200; round++) {
+		for (int i = 0; i < 64; i++) {
+			pool.detach_task([&] {
+				auto until = std::chrono::steady_clock::now() + std::chrono::microseconds(20);
+				while (std::chrono::steady_clock::now() < until) {
+				}
+				done.fetch_add(1);
+			});
+		}
+		submitted += 64;
+		pool.reset(round % 2 == 0 ? 2 : 4);
+	}
+	pool.wait_idle();
+	CHECK(done.load() == submitted);
+}
+
+}  // namespace
+
+int main() {
+	grow_while_shrink_waits();
+	concurrent_resets();
+	shrink_while_elastic_grows();
+	return 0;
+}
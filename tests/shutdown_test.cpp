@@ -0,0 +1,172 @@
+// shutdown(Shutdown::cancel_pending) dropping the helper jobs of a blocking call made from outside the pool or a
+// coroutine's resumption, and the calls that add work to a pool once it has been shut down
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <stdexcept>
+#include <thread>
+
+#include "ThreadPool.hpp"
+#include "check.h"
+
+namespace {
+
+/// @brief Keeps every worker of a pool busy until released, so that whatever is queued next stays queued
+struct BusyWorkers {
+	explicit BusyWorkers(ThreadPool& pool) {
+		for (size_t i = 0; i < pool.size(); i++) {
+			pool.detach_task([this] {
+				busy.fetch_add(1);
+				while (!released.load()) {
+					std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				}
+			});
+		}
+		while (busy.load() < pool.size()) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+
+	/// @brief Shuts the pool down, releasing the workers once it has stopped taking jobs
+	size_t cancel(ThreadPool& pool) {
+		std::thread releaser([this] {
+			std::this_thread::sleep_for(std::chrono::milliseconds(20));
+			released = true;
+		});
+		size_t dropped = pool.shutdown(Shutdown::cancel_pending);
+		releaser.join();
+		return dropped;
+	}
+
+	std::atomic<size_t> busy = 0;
+	std::atomic<bool> released = false;
+};
+
+/// The caller finishes the loop itself, then must not wait forever for its dropped helpers
+void loop_helpers_dropped() {
+	ThreadPool pool(2);
+	BusyWorkers workers(pool);
+	std::atomic<size_t> ran = 0;
+	for (int i = 0; i < 5; i++) {
+		pool.detach_task([&] { ran.fetch_add(1); });
+	}
+	std::atomic<size_t> sum = 0;
+	std::thread caller([&] { pool.run_loop(0, 1000, [&](size_t i) { sum.fetch_add(i); }); });
+	// The caller claims the whole loop while the workers are busy, then waits for its helpers
+	while (sum.load() != 999 * 1000 / 2) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	size_t dropped = workers.cancel(pool);
+	caller.join();
+	// Only the detached tasks count as dropped, not the loop's helper jobs
+	CHECK(dropped == 5);
+	CHECK(ran.load() == 0);
+}
+
+/// A graph root dropped with its helper job is skipped along with its successors, and reported
+void graph_root_dropped() {
+	ThreadPool pool(1);
+	BusyWorkers workers(pool);
+	TaskGraph graph;
+	std::atomic<bool> first_ran = false;
+	std::atomic<bool> dropped_ran = false;
+	graph.add_node([&] { first_ran = true; });
+	TaskGraph::NodeId root = graph.add_node([&] { dropped_ran = true; });
+	TaskGraph::NodeId successor = graph.add_node([&] { dropped_ran = true; });
+	graph.add_edge(root, successor);
+	std::promise<void> finished;
+	std::future<void> result = finished.get_future();
+	std::thread caller([&] {
+		try {
+			pool.run_graph(graph);
+			finished.set_value();
+		} catch (...) {
+			finished.set_exception(std::current_exception());
+		}
+	});
+	while (!first_ran.load()) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	size_t dropped = workers.cancel(pool);
+	caller.join();
+	CHECK(dropped == 0);
+	CHECK(!dropped_ran.load());
+	bool broken = false;
+	try {
+		result.get();
+	} catch (const std::future_error& error) {
+		broken = error.code() == std::future_errc::broken_promise;
+	}
+	CHECK(broken);
+}
+
+/// @brief Whether call throws std::logic_error
+template <typename Call>
+bool rejected(Call&& call) {
+	try {
+		call();
+	} catch (const std::logic_error&) {
+		return true;
+	}
+	return false;
+}
+
+/// @brief How a coroutine's co_await pool.schedule() ended
+enum class Hop { resumed, rejected, dropped };
+
+AsyncTask<Hop> hop(ThreadPool& pool, WaitGroup* queued = nullptr) {
+	try {
+		co_await pool.schedule({.group = queued});
+	} catch (const std::future_error& error) {
+		co_return error.code() == std::future_errc::broken_promise ? Hop::dropped : Hop::resumed;
+	} catch (const std::logic_error&) {
+		co_return Hop::rejected;
+	}
+	co_return Hop::resumed;
+}
+
+/// Nothing is queued, or waited for, once the pool has stopped
+void work_after_shutdown_rejected() {
+	ThreadPool pool(2);
+	pool.shutdown();
+	std::atomic<size_t> ran = 0;
+	CHECK(rejected([&] { pool.detach_task([&] { ran.fetch_add(1); }); }));
+	CHECK(rejected([&] { pool.try_detach_task([&] { ran.fetch_add(1); }); }));
+	CHECK(rejected([&] { pool.detach_task([&] { ran.fetch_add(1); }, {.worker = 0}); }));
+	CHECK(rejected([&] { (void)pool.submit([&] { return ran.fetch_add(1); }); }));
+	CHECK(rejected([&] { pool.run_loop(0, 10, [&](size_t) { ran.fetch_add(1); }); }));
+	CHECK(rejected([&] { (void)pool.schedule_after(std::chrono::milliseconds(1), [&] { ran.fetch_add(1); }); }));
+	CHECK(ran.load() == 0);
+	CHECK(sync_wait(hop(pool)) == Hop::rejected);
+}
+
+/// A coroutine whose queued resumption is dropped is still resumed, with broken_promise, instead of hanging
+void resumption_dropped() {
+	ThreadPool pool(1);
+	BusyWorkers workers(pool);
+	std::promise<Hop> hopped;
+	std::future<Hop> result = hopped.get_future();
+	WaitGroup queued;
+	std::thread caller([&] { hopped.set_value(sync_wait(hop(pool, &queued))); });
+	// The coroutine runs on the caller until its resumption is queued behind the busy worker; the group counts it
+	// just before it is pushed
+	while (queued.is_done()) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	std::this_thread::sleep_for(std::chrono::milliseconds(5));
+	size_t dropped = workers.cancel(pool);
+	caller.join();
+	CHECK(dropped == 1);
+	CHECK(result.get() == Hop::dropped);
+}
+
+}  // namespace
+
+int main() {
+	loop_helpers_dropped();
+	graph_root_dropped();
+	work_after_shutdown_rejected();
+	resumption_dropped();
+	return 0;
+}
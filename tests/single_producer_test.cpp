@@ -0,0 +1,46 @@
+// A SingleProducerQueue pool whose one outside submitter races the pool's own pushes into the global lanes
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "ThreadPool.hpp"
+#include "check.h"
+
+namespace {
+
+using Pool = BasicThreadPool<SingleProducerQueue<64>>;
+
+/// Tasks that submit tasks, nested run_loop helpers and timer jobs, all in global queue mode, while the main
+/// thread keeps the small ring full
+void pool_pushes_beside_producer(bool dedicated_timer_thread) {
+	Pool pool(4, SchedulingMode::global_queue, {}, {}, {}, {.dedicated_thread = dedicated_timer_thread});
+	std::atomic<size_t> ran = 0;
+	std::atomic<size_t> loop_indices = 0;
+	std::atomic<size_t> timers_fired = 0;
+	constexpr size_t rounds = 2000;
+	for (size_t i = 0; i < rounds; i++) {
+		pool.detach_task([&pool, &ran, &loop_indices] {
+			pool.detach_task([&ran] { ran.fetch_add(1); });
+			pool.run_loop(0, 8, [&](size_t) { loop_indices.fetch_add(1); });
+			ran.fetch_add(1);
+		});
+		if (i % 100 == 0) {
+			pool.schedule_after(std::chrono::microseconds(100), [&] { timers_fired.fetch_add(1); });
+		}
+	}
+	while (timers_fired.load() < rounds / 100) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	pool.wait_idle();
+	CHECK(ran.load() == 2 * rounds);
+	CHECK(loop_indices.load() == 8 * rounds);
+}
+
+}  // namespace
+
+int main() {
+	pool_pushes_beside_producer(false);
+	pool_pushes_beside_producer(true);
+	return 0;
+}
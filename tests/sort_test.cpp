@@ -0,0 +1,74 @@
+// parallel_sort against std::sort, for even and odd numbers of merge rounds and for both merge paths
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "ThreadPool.hpp"
+#include "check.h"
+
+namespace {
+
+/// @brief Not default constructible, so parallel_sort merges it in place
+struct Key {
+	explicit Key(int value) : value(value) {}
+
+	bool operator<(const Key& other) const {
+		return value < other.value;
+	}
+
+	bool operator==(const Key& other) const = default;
+
+	int value;
+};
+
+std::vector<int> random_values(size_t count, int range, unsigned seed) {
+	std::mt19937 random(seed);
+	std::uniform_int_distribution<int> value(0, range);
+	std::vector<int> values(count);
+	for (int& v : values) {
+		v = value(random);
+	}
+	return values;
+}
+
+/// Sorts with every pool size up to 8 workers, so the runs take from 1 up to 4 merge rounds
+void sorts_like_std_sort() {
+	for (size_t threads = 1; threads <= 8; threads++) {
+		ThreadPool pool(threads);
+		for (size_t count : {0, 1, 5000, 100'003}) {
+			// A small range of values gives long runs of equal keys across the merge splits
+			for (int range : {3, 1 << 30}) {
+				std::vector<int> values = random_values(count, range, static_cast<unsigned>(threads * count));
+				std::vector<int> expected = values;
+				std::sort(expected.begin(), expected.end());
+				pool.parallel_sort(values.begin(), values.end());
+				CHECK(values == expected);
+				std::sort(expected.begin(), expected.end(), std::greater<>());
+				pool.parallel_sort(values.begin(), values.end(), std::greater<>());
+				CHECK(values == expected);
+			}
+		}
+	}
+}
+
+void sorts_without_default_constructor() {
+	ThreadPool pool(5);
+	std::vector<int> values = random_values(50'000, 100, 7);
+	std::vector<Key> keys;
+	for (int v : values) {
+		keys.emplace_back(v);
+	}
+	std::vector<Key> expected = keys;
+	std::sort(expected.begin(), expected.end());
+	pool.parallel_sort(keys.begin(), keys.end());
+	CHECK(keys == expected);
+}
+
+}  // namespace
+
+int main() {
+	sorts_like_std_sort();
+	sorts_without_default_constructor();
+	return 0;
+}
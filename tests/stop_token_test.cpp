@@ -0,0 +1,110 @@
+// TaskOptions::stop_token: queued tasks whose token is stopped are skipped, their futures reporting
+// broken_promise, and a running task taking a std::stop_token sees its own token or the pool's stop
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <stop_token>
+#include <thread>
+#include <vector>
+
+#include "ThreadPool.hpp"
+#include "check.h"
+
+namespace {
+
+/// @brief Occupies the only worker of a pool until released
+struct BusyWorker {
+	explicit BusyWorker(ThreadPool& pool) {
+		pool.detach_task([this] {
+			busy = true;
+			while (!released.load()) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+		});
+		while (!busy.load()) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+
+	std::atomic<bool> busy = false;
+	std::atomic<bool> released = false;
+};
+
+template <typename T>
+bool broken(TaskFuture<T>& future) {
+	try {
+		future.get();
+	} catch (const std::future_error& error) {
+		return error.code() == std::future_errc::broken_promise;
+	}
+	return false;
+}
+
+/// Tasks still queued when their token is stopped never run, whether submitted, detached or in a group
+void queued_tasks_skipped() {
+	ThreadPool pool(1);
+	BusyWorker worker(pool);
+	std::stop_source cancel;
+	std::atomic<int> ran = 0;
+	std::vector<TaskFuture<int>> skipped;
+	WaitGroup group;
+	for (int i = 0; i < 5; i++) {
+		skipped.push_back(pool.submit({.stop_token = cancel.get_token()}, [&] { return ran.fetch_add(1); }));
+		pool.detach_task([&] { ran.fetch_add(1); }, {.group = &group, .stop_token = cancel.get_token()});
+		// A task taking a token of its own is skipped just the same
+		pool.detach_task([&](std::stop_token) { ran.fetch_add(1); }, {.stop_token = cancel.get_token()});
+	}
+	std::stop_source other;
+	TaskFuture<int> kept = pool.submit({.stop_token = other.get_token()}, [] { return 42; });
+	cancel.request_stop();
+	worker.released = true;
+	pool.wait(group);
+	pool.wait_idle();
+	CHECK(ran.load() == 0);
+	for (TaskFuture<int>& future : skipped) {
+		CHECK(broken(future));
+	}
+	CHECK(kept.get() == 42);
+}
+
+/// A running task gets a token stopped by its own source, or by the pool once it shuts down
+void running_task_sees_stop() {
+	ThreadPool pool(2);
+	std::stop_source cancel;
+	std::atomic<bool> started = false;
+	TaskFuture<int> own = pool.submit({.stop_token = cancel.get_token()}, [&](std::stop_token stop) {
+		started = true;
+		while (!stop.stop_requested()) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		return 1;
+	});
+	while (!started.load()) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	cancel.request_stop();
+	CHECK(own.get() == 1);
+	// Without a token in its options, it is the pool's stop that the task sees
+	started = false;
+	TaskFuture<int> pooled = pool.submit([&](std::stop_token stop) {
+		started = true;
+		while (!stop.stop_requested()) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		return 2;
+	});
+	while (!started.load()) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	pool.shutdown(Shutdown::cancel_pending);
+	CHECK(pooled.get() == 2);
+}
+
+}  // namespace
+
+int main() {
+	queued_tasks_skipped();
+	running_task_sees_stop();
+	return 0;
+}
@@ -0,0 +1,117 @@
+// ThreadPool::Strand: FIFO order, one task at a time, the requeue after every strand_batch tasks, and a requeue
+// that fails because the pool shut down meanwhile
+
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "ThreadPool.hpp"
+#include "check.h"
+
+namespace {
+
+constexpr size_t batch = 64;
+
+/// Tasks added from several threads run one at a time, each thread's in the order it added them
+void runs_in_order_one_at_a_time() {
+	ThreadPool pool(4);
+	ThreadPool::Strand strand(pool);
+	constexpr size_t producers = 3;
+	constexpr size_t per_producer = 5000;
+	std::vector<size_t> order;  // only touched by the strand's tasks
+	std::atomic<int> inside = 0;
+	std::atomic<bool> overlapped = false;
+	std::vector<std::thread> threads;
+	for (size_t p = 0; p < producers; p++) {
+		threads.emplace_back([&, p] {
+			for (size_t i = 0; i < per_producer; i++) {
+				strand.detach_task([&, value = p * per_producer + i] {
+					if (inside.fetch_add(1) != 0) {
+						overlapped = true;
+					}
+					order.push_back(value);
+					inside.fetch_sub(1);
+				});
+			}
+		});
+	}
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+	pool.wait_idle();
+	CHECK(!overlapped.load());
+	CHECK(order.size() == producers * per_producer);
+	std::vector<size_t> next(producers, 0);
+	for (size_t value : order) {
+		size_t p = value / per_producer;
+		CHECK(value % per_producer == next[p]);
+		next[p]++;
+	}
+}
+
+/// After a batch of tasks the strand's job goes back behind the pool's other work
+void requeues_after_a_batch() {
+	ThreadPool pool(1, SchedulingMode::global_queue);
+	std::atomic<bool> released = false;
+	pool.detach_task([&] {
+		while (!released.load()) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	});
+	ThreadPool::Strand strand(pool);
+	size_t ran = 0;
+	for (size_t i = 0; i < 3 * batch; i++) {
+		strand.detach_task([&] { ran++; });
+	}
+	size_t ran_before_other = 0;
+	pool.detach_task([&] { ran_before_other = ran; });
+	released = true;
+	pool.wait_idle();
+	CHECK(ran == 3 * batch);
+	CHECK(ran_before_other == batch);
+}
+
+/// A shutdown between two batches leaves the rest of the strand queued instead of stuck as scheduled
+void requeue_fails_at_shutdown() {
+	ThreadPool pool(1, SchedulingMode::global_queue);
+	ThreadPool::Strand strand(pool);
+	std::atomic<bool> started = false;
+	std::atomic<bool> released = false;
+	strand.detach_task([&] {
+		started = true;
+		while (!released.load()) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	});
+	for (size_t i = 1; i < 2 * batch; i++) {
+		strand.detach_task([] {});
+	}
+	while (!started.load()) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	std::thread releaser([&] {
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		released = true;
+	});
+	pool.shutdown(Shutdown::cancel_pending);
+	releaser.join();
+	CHECK(strand.pending() == batch);
+	bool rejected = false;
+	try {
+		strand.detach_task([] {});
+	} catch (const std::logic_error&) {
+		rejected = true;
+	}
+	CHECK(rejected);
+}
+
+}  // namespace
+
+int main() {
+	runs_in_order_one_at_a_time();
+	requeues_after_a_batch();
+	requeue_fails_at_shutdown();
+	return 0;
+}
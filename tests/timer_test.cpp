@@ -0,0 +1,191 @@
+// Timers: the wheel cascading timers down its levels, and, on a pool, periodic phase, skipped runs and cancel
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "ThreadPool.hpp"
+#include "check.h"
+
+namespace {
+
+using namespace std::chrono;
+
+/// @brief The ticks at which a wheel expired its nodes, by node
+struct Expiries {
+	explicit Expiries(size_t count) : nodes(count), ticks(count, 0) {}
+
+	size_t index(const TimerWheel::Node& node) const {
+		return static_cast<size_t>(&node - nodes.data());
+	}
+
+	std::vector<TimerWheel::Node> nodes;
+	std::vector<uint64_t> ticks;  // 0 while not expired
+	std::vector<size_t> order;
+};
+
+/// Every timer expires at its own tick, whichever level (or the overflow list) it started on and however far each
+/// advance goes, and in due order
+void wheel_cascades() {
+	constexpr uint64_t level_1 = 64;
+	constexpr uint64_t level_2 = 64 * 64;
+	constexpr uint64_t level_3 = 64 * 64 * 64;
+	constexpr uint64_t overflow = 64 * 64 * 64 * 64;
+	const std::vector<uint64_t> dues = {1,
+										2,
+										63,
+										level_1,
+										level_1 + 1,
+										2 * level_1 - 1,
+										level_2 - 1,
+										level_2,
+										level_2 + 1,
+										level_3 - 1,
+										level_3,
+										level_3 + level_2 + 5,
+										overflow - 1,
+										overflow,
+										overflow + level_3 + 7,
+										3 * overflow + 1};
+	// Stepping to each due tick exactly, and jumping over all of them at once
+	for (bool jump : {false, true}) {
+		TimerWheel wheel;
+		Expiries expiries(dues.size());
+		for (size_t i = 0; i < dues.size(); i++) {
+			wheel.insert(expiries.nodes[i], dues[i]);
+		}
+		auto expire = [&](TimerWheel::Node& node) {
+			size_t i = expiries.index(node);
+			expiries.ticks[i] = wheel.now();
+			expiries.order.push_back(i);
+		};
+		if (jump) {
+			wheel.advance(dues.back() + 100, expire);
+		} else {
+			for (size_t i = 0; i < dues.size(); i++) {
+				wheel.advance(dues[i] - 1, expire);
+				CHECK(expiries.order.size() == i);
+				wheel.advance(dues[i], expire);
+				CHECK(expiries.order.size() == i + 1);
+			}
+		}
+		CHECK(wheel.empty());
+		CHECK(wheel.next_due() == TimerWheel::never);
+		for (size_t i = 0; i < dues.size(); i++) {
+			CHECK(expiries.ticks[i] == dues[i]);
+			CHECK(expiries.order[i] == i);
+		}
+	}
+}
+
+/// Timers inserted once the wheel has moved on, and removed before their tick, relative to the current tick
+void wheel_inserts_and_removes_later() {
+	TimerWheel wheel;
+	Expiries expiries(4);
+	auto expire = [&](TimerWheel::Node& node) { expiries.ticks[expiries.index(node)] = wheel.now(); };
+	wheel.advance(5000, expire);
+	CHECK(wheel.now() == 5000);
+	wheel.insert(expiries.nodes[0], 5000 + 70);
+	wheel.insert(expiries.nodes[1], 5000 + 300'000);
+	wheel.insert(expiries.nodes[2], 5000 + 4096);
+	// A due tick already passed expires at the next one
+	wheel.insert(expiries.nodes[3], 10);
+	wheel.remove(expiries.nodes[2]);
+	wheel.advance(1'000'000, expire);
+	CHECK(expiries.ticks[0] == 5070);
+	CHECK(expiries.ticks[1] == 305'000);
+	CHECK(expiries.ticks[2] == 0);
+	CHECK(expiries.ticks[3] == 5001);
+	CHECK(wheel.empty());
+}
+
+/// A periodic timer runs at the multiples of its period, even after a slow run made it skip some, and its runs
+/// never overlap
+void periodic_keeps_phase() {
+	constexpr milliseconds period(20);
+	ThreadPool pool(2, SchedulingMode::work_stealing, {}, {}, {}, {.tick = milliseconds(1)});
+	std::mutex lock;
+	std::vector<milliseconds> starts;
+	std::atomic<int> inside = 0;
+	std::atomic<bool> overlapped = false;
+	steady_clock::time_point origin = steady_clock::now();
+	ScheduledTask timer = pool.schedule_every(period, [&] {
+		if (inside.fetch_add(1) != 0) {
+			overlapped = true;
+		}
+		size_t run;
+		{
+			std::scoped_lock<std::mutex> guard(lock);
+			starts.push_back(duration_cast<milliseconds>(steady_clock::now() - origin));
+			run = starts.size();
+		}
+		// The second run outlasts two more periods, which are skipped
+		if (run == 2) {
+			std::this_thread::sleep_for(2 * period + period / 2);
+		}
+		inside.fetch_sub(1);
+	});
+	for (;;) {
+		std::this_thread::sleep_for(milliseconds(1));
+		std::scoped_lock<std::mutex> guard(lock);
+		if (starts.size() >= 4) {
+			break;
+		}
+	}
+	CHECK(timer.cancel());
+	CHECK(!timer.pending());
+	pool.wait_idle();
+	std::this_thread::sleep_for(2 * period);
+	std::scoped_lock<std::mutex> guard(lock);
+	CHECK(!overlapped.load());
+	// The second run starts at 2 periods and ends after 4.5, so the third starts at 5
+	const std::vector<int> periods = {1, 2, 5, 6};
+	CHECK(starts.size() == periods.size());
+	for (size_t i = 0; i < periods.size(); i++) {
+		milliseconds due = periods[i] * period;
+		CHECK(starts[i] >= due - milliseconds(1));
+		CHECK(starts[i] < due + milliseconds(15));
+	}
+}
+
+/// Cancelling stops a timer and releases its task; a timer that already ran cannot be cancelled
+void cancel_stops_timer() {
+	ThreadPool pool(2);
+	auto resource = std::make_shared<int>(0);
+	std::atomic<int> ran = 0;
+	ScheduledTask cancelled = pool.schedule_after(milliseconds(30), [&, resource] { ran.fetch_add(1); });
+	CHECK(cancelled.pending());
+	CHECK(resource.use_count() == 2);
+	CHECK(cancelled.cancel());
+	CHECK(!cancelled.cancel());
+	CHECK(!cancelled.pending());
+	CHECK(resource.use_count() == 1);
+	std::atomic<bool> fired = false;
+	ScheduledTask once = pool.schedule_after(milliseconds(1), [&] { fired = true; });
+	while (!fired.load()) {
+		std::this_thread::sleep_for(milliseconds(1));
+	}
+	pool.wait_idle();
+	CHECK(!once.pending());
+	CHECK(!once.cancel());
+	std::this_thread::sleep_for(milliseconds(60));
+	CHECK(ran.load() == 0);
+	// An empty handle has nothing to cancel
+	ScheduledTask empty;
+	CHECK(!empty.cancel());
+	CHECK(!empty.pending());
+}
+
+}  // namespace
+
+int main() {
+	wheel_cascades();
+	wheel_inserts_and_removes_later();
+	periodic_keeps_phase();
+	cancel_stops_timer();
+	return 0;
+}
@@ -0,0 +1,96 @@
+// Nested WaitGroups: a parent counts each child group with work as one piece of its own, through several levels
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "ThreadPool.hpp"
+#include "check.h"
+
+namespace {
+
+/// Waiting for the root waits for the tasks of every group below it, and a finished subtree does not finish it
+void parent_waits_for_children() {
+	ThreadPool pool(4);
+	WaitGroup frame;
+	WaitGroup physics(frame, 0);
+	WaitGroup collisions(physics, 0);
+	WaitGroup audio(frame, 0);
+	std::atomic<bool> physics_released = false;
+	std::atomic<bool> audio_released = false;
+	std::atomic<int> ran = 0;
+	auto task = [&](std::atomic<bool>& released) {
+		return [&] {
+			while (!released.load()) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+			ran.fetch_add(1);
+		};
+	};
+	for (int i = 0; i < 3; i++) {
+		pool.detach_task(task(physics_released), {.group = &physics});
+		pool.detach_task(task(physics_released), {.group = &collisions});
+	}
+	pool.detach_task(task(audio_released), {.group = &audio});
+	// Every group with work holds its parent, up to the root
+	CHECK(!frame.is_done());
+	CHECK(!physics.is_done());
+	CHECK(!collisions.is_done());
+	CHECK(!audio.is_done());
+	physics_released = true;
+	pool.wait(physics);
+	CHECK(ran.load() == 6);
+	CHECK(collisions.is_done());
+	CHECK(!frame.is_done());
+	audio_released = true;
+	pool.wait(frame);
+	CHECK(ran.load() == 7);
+	CHECK(audio.is_done());
+}
+
+/// A child that has finished and gets work again counts toward its parent again
+void child_rearms_parent() {
+	ThreadPool pool(2);
+	WaitGroup parent;
+	WaitGroup child(parent, 0);
+	std::atomic<int> ran = 0;
+	for (int round = 1; round <= 3; round++) {
+		pool.detach_task([&] { ran.fetch_add(1); }, {.group = &child});
+		pool.wait(parent);
+		CHECK(child.is_done());
+		CHECK(ran.load() == round);
+	}
+	// A count given at construction holds the parent right away
+	WaitGroup primed(parent, 2);
+	CHECK(!parent.is_done());
+	primed.done();
+	CHECK(!parent.is_done());
+	primed.done();
+	CHECK(parent.is_done());
+}
+
+/// A worker waiting on a parent runs the children's queued tasks instead of blocking
+void worker_waits_on_parent() {
+	ThreadPool pool(1);
+	std::atomic<int> ran = 0;
+	pool.submit([&] {
+			WaitGroup parent;
+			WaitGroup left(parent, 0);
+			WaitGroup right(parent, 0);
+			for (int i = 0; i < 10; i++) {
+				pool.detach_task([&] { ran.fetch_add(1); }, {.group = i % 2 == 0 ? &left : &right});
+			}
+			pool.wait(parent);
+		})
+		.get();
+	CHECK(ran.load() == 10);
+}
+
+}  // namespace
+
+int main() {
+	parent_waits_for_children();
+	child_rearms_parent();
+	worker_waits_on_parent();
+	return 0;
+}